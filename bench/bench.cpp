@@ -0,0 +1,399 @@
+// Reproducible throughput benchmark: replays a fixed frame set (synthetic road
+// scenes plus data/images) at several resolutions and thread counts, reports
+// frames/sec end to end and per stage, and compares against a stored baseline.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "config_file.hpp"
+#include "detector.hpp"
+#include "pipeline.hpp"
+#include "profiler.hpp"
+#include "fs_compat.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string image_dir = "data/images/";
+    std::string baseline_path = "bench/baseline.cfg";
+    std::string json_path;
+    std::vector<cv::Size> resolutions = {{640, 360}, {1280, 720}, {1920, 1080}};
+    std::vector<int> threads = {1, 2, 4};
+    int synthetic_frames = 120;
+    int repeat = 3;            // best of N replays per case
+    double tolerance = 0.10;   // allowed throughput drop against the baseline
+    bool update_baseline = false;
+    bool record_missing = false;  // no baseline yet: record one instead of failing
+    DetectorParams detector;
+};
+
+// JPEG-encoded frames, grouped by stream and in capture order within each;
+// decoding is part of every replay
+struct FrameSet {
+    std::string name;
+    std::vector<std::vector<uchar>> frames;
+    std::vector<size_t> stream;  // per frame
+    size_t n_streams = 1;
+};
+
+// A real frame and the stream collect_frame_jobs() assigned it to
+struct StreamImage {
+    size_t stream = 0;
+    cv::Mat image;
+};
+
+struct CaseResult {
+    std::string key;  // "<set>/<width>x<height>/t<threads>"
+    double fps = 0.0;
+    ProfileReport profile;
+};
+
+bool parse_resolutions(const std::string& list, std::vector<cv::Size>& sizes) {
+    sizes.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int w = 0, h = 0;
+        char x = 0;
+        std::stringstream is(item);
+        if (!(is >> w >> x >> h) || x != 'x' || w < 16 || h < 16) return false;
+        sizes.emplace_back(w, h);
+    }
+    return !sizes.empty();
+}
+
+bool parse_threads(const std::string& list, std::vector<int>& threads) {
+    threads.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int n = std::atoi(item.c_str());
+        if (n < 1) return false;
+        threads.push_back(n);
+    }
+    return !threads.empty();
+}
+
+void encode_frame(const cv::Mat& image, FrameSet& set, size_t stream = 0) {
+    set.frames.emplace_back();
+    cv::imencode(".jpg", image, set.frames.back());
+    set.stream.push_back(stream);
+}
+
+// Static textured road with vehicles moving along alternating-direction lanes.
+// Everything derives from a fixed seed, so every run sees the same frames.
+FrameSet synthetic_frames(cv::Size size, int n_frames) {
+    FrameSet set;
+    set.name = "synthetic";
+
+    cv::RNG rng(12345);
+    cv::Mat background(size, CV_8UC3);
+    rng.fill(background, cv::RNG::NORMAL, cv::Scalar(110, 110, 110), cv::Scalar(12, 12, 12));
+
+    const int n_lanes = 4;
+    const int lane_height = size.height / 8;
+    const int road_top = size.height * 3 / 10;
+    for (int lane = 0; lane <= n_lanes; ++lane) {
+        int y = road_top + lane * lane_height;
+        cv::line(background, {0, y}, {size.width, y}, cv::Scalar(200, 200, 200), std::max(1, size.height / 180));
+    }
+
+    struct Vehicle {
+        int lane, start_frame, width, height;
+        double speed;
+        cv::Scalar color;
+    };
+    std::vector<Vehicle> vehicles;
+    for (int lane = 0; lane < n_lanes; ++lane) {
+        for (int start = rng.uniform(0, 10); start < n_frames; start += rng.uniform(15, 30)) {
+            Vehicle v;
+            v.lane = lane;
+            v.start_frame = start;
+            v.width = static_cast<int>(size.width * rng.uniform(0.08, 0.14));
+            v.height = static_cast<int>(lane_height * rng.uniform(0.55, 0.8));
+            v.speed = size.width / rng.uniform(40.0, 70.0);
+            v.color = cv::Scalar(rng.uniform(0, 255), rng.uniform(0, 255), rng.uniform(0, 255));
+            vehicles.push_back(v);
+        }
+    }
+
+    cv::Mat frame, noise(size, CV_8UC3);
+    for (int f = 0; f < n_frames; ++f) {
+        background.copyTo(frame);
+        for (const auto& v : vehicles) {
+            if (f < v.start_frame) continue;
+            int travelled = static_cast<int>((f - v.start_frame) * v.speed);
+            int x = v.lane % 2 == 0 ? travelled - v.width : size.width - travelled;
+            if (x > size.width || x + v.width < 0) continue;
+            int y = road_top + v.lane * lane_height + (lane_height - v.height) / 2;
+            cv::Rect body(x, y, v.width, v.height);
+            cv::rectangle(frame, body, v.color, cv::FILLED);
+            cv::rectangle(frame, cv::Rect(x + v.width / 4, y + v.height / 5, v.width / 2, v.height * 3 / 5),
+                          v.color * 0.5, cv::FILLED);
+        }
+        // Sensor noise, so the background model has something to absorb
+        rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar(0, 0, 0), cv::Scalar(6, 6, 6));
+        frame += noise;
+        encode_frame(frame, set);
+    }
+    return set;
+}
+
+FrameSet image_frames(const std::vector<StreamImage>& images, size_t n_streams, cv::Size size) {
+    FrameSet set;
+    set.name = "images";
+    set.n_streams = std::max<size_t>(1, n_streams);
+    cv::Mat resized;
+    for (const auto& image : images) {
+        cv::resize(image.image, resized, size, 0, 0, cv::INTER_AREA);
+        encode_frame(resized, set, image.stream);
+    }
+    return set;
+}
+
+// Every thread replays the whole frame set with one detector per stream, as
+// run_batch() does, so each background model only sees its own stream.
+// Stages: decode, detect, annotate, encode (to memory).
+double replay(const FrameSet& set, int n_threads, const DetectorParams& params) {
+    auto worker = [&]() {
+        std::vector<std::unique_ptr<VehicleDetector>> detectors(set.n_streams);
+        cv::Mat image, gray, mask, morph;
+        std::vector<uchar> encoded;
+        for (size_t f = 0; f < set.frames.size(); ++f) {
+            {
+                ScopedTimer timer(Stage::Decode);
+                image = cv::imdecode(set.frames[f], cv::IMREAD_COLOR);
+            }
+            if (image.empty()) continue;
+            auto& detector = detectors[set.stream[f]];
+            if (!detector) detector = std::make_unique<VehicleDetector>(params);
+            std::vector<cv::Rect> boxes = detector->detect(image, gray, mask, morph);
+            annotate_frame(image, boxes);
+            ScopedTimer timer(Stage::Encode);
+            cv::imencode(".jpg", image, encoded);
+        }
+    };
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < n_threads; ++t) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return seconds > 0 ? n_threads * set.frames.size() / seconds : 0.0;
+}
+
+bool load_baseline(const std::string& path, std::map<std::string, double>& baseline) {
+    return read_config_file(path, "baseline", [&](const std::string& key, const std::string& value) {
+        char* end = nullptr;
+        baseline[key] = std::strtod(value.c_str(), &end);
+        return !key.empty() && end != value.c_str() && *end == '\0';
+    });
+}
+
+bool save_baseline(const std::string& path, const std::vector<CaseResult>& results) {
+    fs::path parent = fs::path(path).parent_path();
+    if (!parent.empty()) fs::create_directories(parent);
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to write to file: " << path << std::endl;
+        return false;
+    }
+    ofs << "# vehicle_counter_bench baseline, frames/sec per case (best of the replays)\n"
+        << "# Recorded on a machine with " << std::thread::hardware_concurrency() << " hardware threads\n";
+    ofs << std::fixed << std::setprecision(1);
+    for (const auto& result : results) ofs << result.key << " = " << result.fps << "\n";
+    return static_cast<bool>(ofs);
+}
+
+bool save_json(const std::string& path, const std::vector<CaseResult>& results) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to write to file: " << path << std::endl;
+        return false;
+    }
+    ofs << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        ofs << (i == 0 ? "\n" : ",\n") << "  {\"case\": \"" << results[i].key << "\", \"fps\": "
+            << std::fixed << std::setprecision(3) << results[i].fps << ", \"profile\": ";
+        write_profile_json(ofs, results[i].profile, "  ");
+        ofs << "}";
+    }
+    ofs << "\n]\n";
+    return static_cast<bool>(ofs);
+}
+
+void print_usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]\n"
+              << "  --images DIR          real frames to replay next to the synthetic ones (default: data/images/)\n"
+              << "  --no-images           replay synthetic frames only\n"
+              << "  --frames N            synthetic frames per resolution (default: 120)\n"
+              << "  --resolutions LIST    e.g. 640x360,1280x720,1920x1080 (the default)\n"
+              << "  --threads LIST        thread counts, e.g. 1,2,4 (the default)\n"
+              << "  --repeat N            replays per case, the fastest counts (default: 3)\n"
+              << "  --config FILE         detector parameters\n"
+              << "  --baseline FILE       stored frames/sec per case (default: bench/baseline.cfg)\n"
+              << "  --tolerance F         fail when a case is more than F slower than the baseline (default: 0.10)\n"
+              << "  --update-baseline     write the measured numbers as the new baseline\n"
+              << "  --record-missing      record the baseline when the file does not exist yet\n"
+              << "  --json FILE           write fps and per-stage profiles of every case\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--images" && i + 1 < argc) {
+            options.image_dir = argv[++i];
+        } else if (arg == "--no-images") {
+            options.image_dir.clear();
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.synthetic_frames = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--resolutions" && i + 1 < argc) {
+            if (!parse_resolutions(argv[++i], options.resolutions)) {
+                std::cerr << "Invalid resolution list: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            if (!parse_threads(argv[++i], options.threads)) {
+                std::cerr << "Invalid thread list: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--config" && i + 1 < argc) {
+            if (!load_detector_params(argv[++i], options.detector)) return 1;
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baseline_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = std::atof(argv[++i]);
+        } else if (arg == "--update-baseline") {
+            options.update_baseline = true;
+        } else if (arg == "--record-missing") {
+            options.record_missing = true;
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Without a baseline there is nothing to compare against; record one when
+    // asked to, otherwise fail before the long run
+    if (!options.update_baseline && !fs::is_regular_file(options.baseline_path)) {
+        if (!options.record_missing) {
+            std::cerr << "[BENCH] no baseline at " << options.baseline_path
+                      << "; run with --update-baseline to record one" << std::endl;
+            return 1;
+        }
+        std::cout << "[BENCH] no baseline at " << options.baseline_path << " yet; this run records it\n";
+        options.update_baseline = true;
+    }
+
+    // Only the benchmark's own threads run, so thread scaling is measured as is
+    cv::setNumThreads(1);
+
+    // Jobs come interleaved across streams; regroup them so every stream's
+    // frames are consecutive and in order
+    std::vector<StreamImage> images;
+    size_t n_streams = 0;
+    if (!options.image_dir.empty() && fs::is_directory(options.image_dir)) {
+        std::vector<FrameJob> jobs = collect_frame_jobs(options.image_dir, n_streams);
+        std::stable_sort(jobs.begin(), jobs.end(),
+                         [](const FrameJob& a, const FrameJob& b) { return a.stream < b.stream; });
+        for (const auto& job : jobs) {
+            cv::Mat image = cv::imread(job.path);
+            if (!image.empty()) images.push_back({job.stream, image});
+        }
+    }
+
+    std::vector<CaseResult> results;
+    for (const auto& size : options.resolutions) {
+        std::vector<FrameSet> sets;
+        if (options.synthetic_frames > 0) sets.push_back(synthetic_frames(size, options.synthetic_frames));
+        if (!images.empty()) sets.push_back(image_frames(images, n_streams, size));
+
+        for (const auto& set : sets) {
+            for (int n_threads : options.threads) {
+                CaseResult result;
+                result.key = set.name + "/" + std::to_string(size.width) + "x" + std::to_string(size.height) +
+                             "/t" + std::to_string(n_threads);
+                for (int r = 0; r < options.repeat; ++r) {
+                    enable_profiling(false);
+                    double fps = replay(set, n_threads, options.detector);
+                    disable_profiling();
+                    if (fps > result.fps) {
+                        result.fps = fps;
+                        result.profile = collect_profile();
+                    }
+                }
+                results.push_back(result);
+
+                std::cout << "[BENCH] " << result.key << ": " << std::fixed << std::setprecision(1)
+                          << result.fps << " frames/s\n";
+                for (int s = 0; s < kNumStages; ++s) {
+                    const StageProfile& p = result.profile.stages[s];
+                    if (p.count == 0 || p.total_ms <= 0) continue;
+                    std::cout << "[BENCH]   " << std::left << std::setw(16) << stage_name(static_cast<Stage>(s))
+                              << std::right << std::setw(10) << p.count * 1000.0 / p.total_ms << " /s per thread, p99 "
+                              << p.p99_us << " us\n";
+                }
+            }
+        }
+    }
+
+    if (!options.json_path.empty() && !save_json(options.json_path, results)) return 1;
+
+    if (options.update_baseline) {
+        if (!save_baseline(options.baseline_path, results)) return 1;
+        std::cout << "[BENCH] baseline written to " << options.baseline_path << "\n";
+        return 0;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!load_baseline(options.baseline_path, baseline)) return 1;
+
+    int regressions = 0, compared = 0;
+    for (const auto& result : results) {
+        auto it = baseline.find(result.key);
+        if (it == baseline.end() || it->second <= 0) {
+            std::cout << "[BENCH] " << result.key << ": not in the baseline\n";
+            continue;
+        }
+        ++compared;
+        double change = result.fps / it->second - 1.0;
+        bool regressed = change < -options.tolerance;
+        if (regressed) ++regressions;
+        std::cout << "[BENCH] " << result.key << ": " << std::fixed << std::setprecision(1) << result.fps
+                  << " vs baseline " << it->second << " (" << std::showpos << change * 100.0 << std::noshowpos
+                  << "%)" << (regressed ? "  REGRESSION" : "") << "\n";
+    }
+    if (regressions > 0) {
+        std::cerr << "[BENCH] " << regressions << " case(s) slower than the baseline by more than "
+                  << options.tolerance * 100.0 << "%" << std::endl;
+        return 1;
+    }
+    if (compared == 0) {
+        std::cerr << "[BENCH] no case matches the baseline in " << options.baseline_path
+                  << "; run with --update-baseline to record one" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef CONFIG_FILE_HPP
+#define CONFIG_FILE_HPP
+
+#include <functional>
+#include <string>
+
+// Strips leading and trailing whitespace
+std::string trim(const std::string& s);
+
+// Reads the "key = value" lines of a config file; '#' starts a comment and
+// blank lines are skipped. Calls setting(key, value) with both sides trimmed,
+// key empty when the line has no '='. Returns false, with a message naming
+// the file (and line), when it cannot be opened or setting() rejects a line.
+bool read_config_file(const std::string& path, const std::string& what,
+                      const std::function<bool(const std::string& key, const std::string& value)>& setting);
+
+#endif // CONFIG_FILE_HPP
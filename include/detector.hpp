@@ -27,8 +27,175 @@
 #define DETECTOR_HPP
 
 #include <opencv2/opencv.hpp>
+#include <string>
 #include <vector>
+#include "frontend.hpp"
 
-std::vector<cv::Rect> detect_vehicles(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph);
+// Which implementation produces gray, mask and morph
+enum class FrontEnd {
+    OpenCV,  // cvtColor, MOG2, threshold, morphologyEx (original path)
+    Fused    // FusedFrontEnd: one strip-wise pass with a SIMD approximate-median model
+};
+
+// How foreground blobs are extracted from the cleaned mask.
+// Components is faster but not equivalent: its area is the pixel count, which
+// leaves out holes (contourArea includes them), blobs inside holes become
+// separate candidates, and hulls are built from pixel corners. Extent and
+// solidity therefore come out lower, so it is opt-in until it has been
+// evaluated against the contour path on data/.
+enum class BlobExtractor {
+    Contours,   // findContours, then bbox/area/hull for every contour (original path)
+    Components  // one connectedComponentsWithStats pass; hull only for blobs that pass the cheap filters
+};
+
+constexpr int kMaxPyramidLevel = 4;
+
+// All tuning knobs of the detector. Defaults reproduce the original
+// hard-coded pipeline; load_detector_params() reads them from a config file.
+struct DetectorParams {
+    FrontEnd front_end = FrontEnd::OpenCV;
+    FusedFrontEndParams fused;  // kernel_size is taken from kernel_size below
+
+    // Fused front end only: also run the OpenCV path on every frame and report
+    // frames whose gray images differ by more than 1 level, whose closing differs
+    // from morphologyEx, or whose final masks disagree on more than this
+    // fraction of pixels. < 0 disables the check.
+    double verify_tolerance = -1.0;
+
+    BlobExtractor blob_extractor = BlobExtractor::Contours;
+
+    // Background subtraction, morphology and blob extraction run at
+    // 1 / 2^pyramid_level of the input size (0 = full resolution). Candidate
+    // boxes are mapped back and refined against the background at full resolution.
+    int pyramid_level = 0;      // 0 .. kMaxPyramidLevel
+    int refine_threshold = 25;  // |gray - background| that counts as foreground when refining
+
+    // MOG2 background model (OpenCV front end)
+    int mog2_history = 500;
+    double mog2_var_threshold = 16.0;
+    int shadow_threshold = 200;  // MOG2 marks shadows as 127; mask values above this are kept
+
+    int kernel_size = 5;  // square closing kernel at full resolution
+
+    // Blob filters. Area limits are fractions of the frame area
+    // (1200 and 100000 px on the 800x600 dataset).
+    double min_area_frac = 1200.0 / (800 * 600);
+    double max_area_frac = 100000.0 / (800 * 600);
+    double min_aspect = 0.4;     // bbox width / height
+    double max_aspect = 4.0;
+    double min_extent = 0.35;    // blob area / bbox area
+    double min_solidity = 0.6;   // blob area / convex hull area
+};
+
+// Sets one parameter from its config file name and textual value.
+// Returns false for an unknown key or a malformed or out-of-range value:
+// thresholds are 0..255, adapt_step 1..255, kernel_size odd and positive,
+// mog2_history positive, area fractions 0..1 and the other limits >= 0.
+bool set_detector_param(DetectorParams& params, const std::string& key, const std::string& value);
+
+// Checks the limits that depend on each other, which set_detector_param()
+// cannot: min_area_frac <= max_area_frac and min_aspect <= max_aspect.
+bool detector_params_consistent(const DetectorParams& params);
+
+// Reads "key = value" lines ('#' starts a comment). Keys missing from the
+// file keep their current value. Returns false on I/O or parse errors and
+// when the resulting limits are inconsistent.
+bool load_detector_params(const std::string& path, DetectorParams& params);
+
+// Writes every parameter in the format load_detector_params() reads
+bool save_detector_params(const std::string& path, const DetectorParams& params);
+
+// The parameters a VehicleDetector actually runs with: pyramid_level clamped
+// to [0, kMaxPyramidLevel] and the fused kernel derived from kernel_size
+DetectorParams sanitized_detector_params(DetectorParams params);
+
+// Geometry of one foreground blob in working-resolution pixels
+struct BlobFeatures {
+    cv::Rect box;
+    double area = 0.0;       // contour area (Contours) or pixel count (Components)
+    double hull_area = 0.0;  // convex hull area in the same units
+};
+
+// The area, aspect, extent and solidity filters, as applied by detect().
+// frame_area is the working-resolution frame area.
+bool accept_blob(const BlobFeatures& blob, const DetectorParams& params, double frame_area);
+
+// Bounding box area limits in pixels, as used by accept_blob()
+void area_limits(const DetectorParams& params, double frame_area, double& min_area, double& max_area);
+
+// Scratch buffers for blob extraction, reused across frames
+struct BlobBuffers {
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Point> hull;
+    std::vector<cv::Point> hull_points;
+    cv::Mat labels, stats, centroids;
+};
+
+// Every blob in morph with its hull area. With `prefilter`, blobs that fail
+// its area, aspect or extent limits are dropped before their hull is built;
+// detect() passes its own parameters, the sweep none.
+void extract_blob_features(const cv::Mat& morph, BlobExtractor extractor,
+                           std::vector<BlobFeatures>& blobs, BlobBuffers& buffers,
+                           const DetectorParams* prefilter = nullptr);
+
+struct RefineBuffers {
+    cv::Mat gray, background, diff;
+};
+
+// Maps a box found at pyramid `level` back to full resolution and tightens it
+// to the pixels of `image` that differ from the (working-resolution)
+// background by more than `threshold`, searched within one working pixel of
+// the box. Falls back to the scaled box when that foreground is sparse.
+cv::Rect refine_box(const cv::Mat& image, const cv::Mat& background, const cv::Rect& box,
+                    int level, int threshold, RefineBuffers& buffers);
+
+// Vehicle detector for a single camera/stream.
+// The background model is temporal, so every stream gets its own instance and
+// frames must be fed in capture order. An instance owns its model and scratch
+// buffers and must not be shared between threads; separate instances can run
+// concurrently.
+class VehicleDetector {
+public:
+    explicit VehicleDetector(const DetectorParams& params = DetectorParams());
+
+    // Full signature for debug support. With pyramid_level > 0, gray, mask and
+    // morph are at the reduced resolution; the returned boxes are always in
+    // input image coordinates.
+    std::vector<cv::Rect> detect(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph);
+
+    // Stage-level access, used by the parameter sweep to cache intermediate results.
+
+    // Downscale, grayscale, background model, shadow threshold and closing.
+    // Updates the background model, so frames must arrive in order.
+    void compute_mask(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph);
+
+    // Current background estimate at working resolution (8-bit gray)
+    void background(cv::Mat& bg);
+
+    // Pyramid level the last frame ran at: pyramid_level, lowered for frames
+    // with a side shorter than 2^pyramid_level
+    int level() const { return level_; }
+
+private:
+    void verify_front_end(const cv::Mat& image, const cv::Mat& gray, const cv::Mat& mask, const cv::Mat& morph);
+    void refine_boxes(const cv::Mat& image, std::vector<cv::Rect>& boxes);
+
+    DetectorParams params_;
+    cv::Ptr<cv::BackgroundSubtractor> bg_subtractor_;
+    cv::Mat kernel_;
+    FusedFrontEnd fused_;
+
+    // Scratch buffers reused across frames
+    BlobBuffers blob_buffers_;
+    std::vector<BlobFeatures> blobs_;
+    cv::Mat small_, small_bg_;
+    RefineBuffers refine_;
+    double frame_area_ = 0;  // working-resolution frame area of the current frame
+    int level_ = 0;          // pyramid level of the current frame
+
+    // Reference outputs for verify_front_end()
+    cv::Mat ref_gray_, ref_mask_, ref_morph_, ref_closed_;
+    long verified_frames_ = 0;
+};
 
 #endif // DETECTOR_HPP
@@ -1,7 +1,9 @@
 // File: include/evaluate.hpp
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 struct BoundingBox {
@@ -22,3 +24,91 @@ struct EvaluationResult {
 std::vector<BoundingBox> parse_ground_truth_xml(const std::string& xml_path);
 EvaluationResult evaluate_predictions(const std::vector<BoundingBox>& gt_boxes,
                                       const std::vector<cv::Rect>& pred_boxes);
+
+// Ground truth boxes keyed by image file stem ("1_1")
+using GroundTruthIndex = std::unordered_map<std::string, std::vector<BoundingBox>>;
+
+// Loads a directory of per-image Pascal VOC files or a single merged file
+// (<dataset><image filename="..."><object name= xmin= .../></image>...).
+// Returns false if nothing could be loaded.
+bool load_ground_truth(const std::string& path, GroundTruthIndex& index);
+
+struct Prediction {
+    cv::Rect box;
+    float score = 1.0f;  // detections without a score rank equally
+};
+
+// Predicted boxes keyed by image file stem
+using PredictionIndex = std::unordered_map<std::string, std::vector<Prediction>>;
+
+// Loads a directory of per-frame "<label> x y w h [score]" text files or a
+// .jsonl / .bin results file written by ResultsSink.
+bool load_predictions(const std::string& path, PredictionIndex& index);
+
+// IoU thresholds 0.50, 0.55, ..., 0.95
+constexpr int kNumIouThresholds = 10;
+constexpr double iou_threshold(int i) { return 0.5 + 0.05 * i; }
+
+struct ImageEvaluation {
+    std::string name;
+    EvaluationResult result;  // at IoU 0.5
+};
+
+struct DatasetEvaluation {
+    EvaluationResult total;  // summed counts at IoU 0.5; precision/recall/F1 from the sums
+    double mean_abs_error = 0.0;
+    double mean_rel_error = 0.0;
+    double ap[kNumIouThresholds] = {};  // per IoU threshold
+    double map = 0.0;                   // mean AP over IoU 0.5:0.95
+    std::vector<ImageEvaluation> images;
+    size_t skipped_images = 0;       // prediction entries with no ground truth entry
+    size_t skipped_predictions = 0;  // boxes in those entries
+};
+
+// Evaluates every image in the ground truth index (missing predictions count
+// as none; predictions for images without ground truth are only counted as
+// skipped) on `threads` threads. Each image's IoU matrix is computed once and
+// matched at all IoU thresholds in the same pass.
+DatasetEvaluation evaluate_dataset(const GroundTruthIndex& ground_truth,
+                                   const PredictionIndex& predictions,
+                                   int threads);
+
+// Per-thread matching buffers, reused across images and calls
+struct MatchScratch {
+    std::vector<float> px1, py1, px2, py2, parea;
+    std::vector<float> iou;
+    struct Pair {
+        float score;
+        float iou;
+        uint32_t gt;
+        uint32_t pred;
+    };
+    std::vector<Pair> pairs;
+    std::vector<uint8_t> gt_used, pred_used;
+};
+
+// Same scoring as evaluate_dataset() for callers that already hold the images
+// in a fixed order (the parameter sweep): predictions[i] belongs to
+// ground_truth[i]. Runs on the calling thread. Without with_ap only IoU 0.5
+// is matched and ap/map stay 0; image names are left empty.
+DatasetEvaluation evaluate_images(const std::vector<const std::vector<BoundingBox>*>& ground_truth,
+                                  const std::vector<std::vector<Prediction>>& predictions,
+                                  bool with_ap, MatchScratch& scratch);
+
+// Draws the IoU 0.5 matching of one image: true positive predictions green,
+// false positive predictions red, missed ground truth boxes (false negatives) blue.
+void draw_match_overlay(cv::Mat& image, const std::vector<BoundingBox>& gt,
+                        const std::vector<Prediction>& preds, MatchScratch& scratch);
+
+struct EvaluateOptions {
+    std::string ground_truth_path = "data/ground_truth/";
+    std::string predictions_path = "output/results/";
+    std::string csv_path;  // optional per-image summary
+    std::string overlay_dir;  // optional TP/FP/FN drawings of the images in image_dir
+    std::string image_dir = "data/images/";
+    int threads = 1;
+};
+
+// Loads ground truth and predictions once, evaluates the dataset and prints
+// precision/recall/F1, count errors and AP. Returns 0 on success.
+int run_evaluate(const EvaluateOptions& options);
@@ -0,0 +1,44 @@
+#ifndef FRONTEND_HPP
+#define FRONTEND_HPP
+
+#include <opencv2/opencv.hpp>
+
+struct FusedFrontEndParams {
+    int fg_threshold = 25;  // |gray - background| above this is foreground, 0..255 (255: none)
+    int adapt_step = 1;     // max background change per frame (approximate median)
+    int kernel_size = 5;    // square closing kernel, odd
+    int strip_rows = 0;     // rows per strip, 0 = sized from the frame width to stay in L2
+};
+
+// Fused detector front end: grayscale conversion, an approximate-median
+// background model, foreground threshold and a separable min/max closing,
+// run over the frame in row strips so each strip is still in cache when the
+// next stage reads it. Gray matches cvtColor and the closing matches
+// morphologyEx CLOSE on the same mask, but the background model is not MOG2,
+// so masks differ from the OpenCV path; tests/frontend_test.cpp checks the
+// outputs against a per-pixel reference of this model.
+//
+// The background update, threshold and min/max kernels use AVX2, SSE2 or
+// NEON when the compiler targets them, with a scalar fallback.
+class FusedFrontEnd {
+public:
+    explicit FusedFrontEnd(const FusedFrontEndParams& params = FusedFrontEndParams());
+
+    // The first frame (or the first after a size change) only seeds the
+    // background model and yields an empty mask.
+    void process(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph);
+
+    // Current background estimate (8-bit gray), empty before the first frame
+    const cv::Mat& background() const { return background_; }
+
+private:
+    FusedFrontEndParams params_;
+    bool initialized_ = false;
+    cv::Mat background_;
+    cv::Mat hmax_;     // horizontal max of mask, ring of strip + 2 * radius rows
+    cv::Mat dilated_;  // vertical max of hmax_, one row
+    cv::Mat hmin_;     // horizontal min of dilated_, ring of strip + 2 * radius rows
+    std::vector<const uchar*> window_;
+};
+
+#endif // FRONTEND_HPP
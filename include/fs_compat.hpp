@@ -0,0 +1,14 @@
+#ifndef FS_COMPAT_HPP
+#define FS_COMPAT_HPP
+
+#if defined(__cpp_lib_filesystem)
+    #include <filesystem>
+    namespace fs = std::filesystem;
+#elif __has_include(<experimental/filesystem>)
+    #include <experimental/filesystem>
+    namespace fs = std::experimental::filesystem;
+#else
+    #error "No filesystem support"
+#endif
+
+#endif // FS_COMPAT_HPP
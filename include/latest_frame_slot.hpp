@@ -0,0 +1,54 @@
+#ifndef LATEST_FRAME_SLOT_HPP
+#define LATEST_FRAME_SLOT_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+// Single-slot "latest value wins" buffer between a producer and a consumer.
+// put() never blocks: a value the consumer has not taken yet is overwritten,
+// so a slow consumer always sees the newest value instead of a growing backlog.
+template <typename T>
+class LatestFrameSlot {
+public:
+    // Returns true if an unconsumed value was overwritten (i.e. dropped).
+    bool put(T value) {
+        bool dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            dropped = full_;
+            value_ = std::move(value);
+            full_ = true;
+        }
+        ready_.notify_one();
+        return dropped;
+    }
+
+    // Blocks until a value is available. Returns false once the slot is
+    // closed and empty.
+    bool take(T& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return full_ || closed_; });
+        if (!full_) return false;
+        value = std::move(value_);
+        full_ = false;
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    T value_{};
+    bool full_ = false;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
+
+#endif // LATEST_FRAME_SLOT_HPP
@@ -0,0 +1,27 @@
+#ifndef PARALLEL_FOR_HPP
+#define PARALLEL_FOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs fn(i, worker) for i in [0, n) on up to `threads` threads, the calling
+// thread included. Each thread takes the next index as it finishes one, so
+// uneven items balance out. worker < max(1, threads) indexes per-thread
+// scratch buffers; the calling thread is always worker 0.
+template <typename Fn>
+void parallel_for(size_t n, int threads, Fn fn) {
+    std::atomic<size_t> next{0};
+    auto worker = [&](size_t w) {
+        for (size_t i = next++; i < n; i = next++) fn(i, w);
+    };
+    const size_t n_threads = std::max<size_t>(1, std::min<size_t>(std::max(1, threads), n));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < n_threads; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : pool) t.join();
+}
+
+#endif // PARALLEL_FOR_HPP
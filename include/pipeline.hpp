@@ -0,0 +1,71 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "detector.hpp"
+#include "tracker.hpp"
+#include "writer.hpp"
+
+struct BatchOptions {
+    std::string image_dir = "data/images/";
+    std::string output_img_dir = "output/images/";
+    std::string output_txt_dir = "output/results/";
+    std::string debug_gray_dir = "debug_output/gray/";
+    std::string debug_mask_dir = "debug_output/mask/";
+    std::string debug_morph_dir = "debug_output/morph/";
+
+    // Worker threads for the decode and annotate/write stages. Detection runs
+    // one thread per stream (up to this many), since each stream's background
+    // model has to see its frames in order.
+    int threads = 1;
+
+    // Settings for every per-stream detector
+    DetectorParams detector;
+
+    // Track vehicles within each stream and count zone crossings; the zones
+    // apply to every stream
+    bool track = false;
+    TrackerParams tracker;
+    std::vector<CountingZone> zones;
+
+    // Capacity of each queue between stages
+    size_t queue_capacity = 32;
+
+    // Debug stage images to dump (DebugStage bits), sampled every debug_every-th frame of a stream
+    unsigned debug_stages = DEBUG_NONE;
+    int debug_every = 1;
+
+    // Detection results; an empty results_path means output_txt_dir for
+    // PerFrameText and output/results.jsonl / output/results.bin otherwise
+    ResultsFormat results_format = ResultsFormat::PerFrameText;
+    std::string results_path;
+
+    // Background JPEG encode/write workers
+    WriterOptions writer;
+};
+
+struct FrameJob {
+    std::string path;
+    std::string name;  // file stem
+    size_t stream = 0;
+    size_t seq = 0;    // position within the stream
+};
+
+// Lists the images in image_dir. Images named "<stream>_<index>.<ext>" are
+// grouped per stream and numbered in index order; other names share one
+// stream ordered by name. Jobs are interleaved by sequence number so parallel
+// decoders make progress on every stream at once.
+std::vector<FrameJob> collect_frame_jobs(const std::string& image_dir, size_t& n_streams);
+
+// Draws the detection boxes onto the image
+void annotate_frame(cv::Mat& image, const std::vector<cv::Rect>& boxes);
+
+// Runs the decode -> detect -> annotate/write pipeline over every image in
+// options.image_dir. Each stream (see collect_frame_jobs) gets its own
+// detector, which sees its frames in index order.
+// Returns the number of frames that failed to load or write.
+int run_batch(const BatchOptions& options);
+
+#endif // PIPELINE_HPP
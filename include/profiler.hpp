@@ -0,0 +1,129 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Pipeline stages timed by ScopedTimer
+enum class Stage : int {
+    Decode,      // imread / imdecode / capture read
+    Resize,      // pyramid downscale
+    Gray,
+    Background,  // MOG2 apply
+    Threshold,   // shadow removal
+    Morphology,
+    FrontEnd,    // fused gray + background + threshold + closing
+    Blobs,       // connected components / contours
+    Filter,      // blob filters and hulls
+    Refine,      // full-resolution box refinement
+    Track,       // association and line/zone counting
+    Annotate,
+    Encode,      // JPEG encoding
+    Write,       // image file writes
+    Results,     // results sink appends
+    Count
+};
+
+constexpr int kNumStages = static_cast<int>(Stage::Count);
+
+const char* stage_name(Stage stage);
+
+// Profiling is off by default; a disabled ScopedTimer costs one relaxed load.
+// Trace events are kept only when trace is set (up to a fixed number per thread).
+void enable_profiling(bool trace);
+void disable_profiling();
+
+// Clears all recorded samples. Must not run concurrently with timed code.
+void reset_profile();
+
+namespace profiler_detail {
+extern std::atomic<bool> enabled;
+// Heap bytes allocated by the current thread. cv::Mat buffers are counted
+// while profiling; operator new only when alloc_counter.cpp is linked in
+// (CMake option VEHICLE_COUNTER_COUNT_ALLOCATIONS).
+extern thread_local uint64_t allocated_bytes;
+int64_t now_ns();
+uint64_t thread_allocated_bytes();
+void record(Stage stage, int64_t start_ns, int64_t end_ns, uint64_t bytes);
+} // namespace profiler_detail
+
+// Times the enclosing scope and the heap bytes it allocates (cv::Mat buffers,
+// plus operator new when counted) on the current thread.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage stage) : stage_(stage) {
+        if (!profiler_detail::enabled.load(std::memory_order_relaxed)) return;
+        active_ = true;
+        bytes_ = profiler_detail::thread_allocated_bytes();
+        start_ns_ = profiler_detail::now_ns();
+    }
+    ~ScopedTimer() {
+        if (!active_) return;
+        int64_t end_ns = profiler_detail::now_ns();
+        profiler_detail::record(stage_, start_ns_, end_ns, profiler_detail::thread_allocated_bytes() - bytes_);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage stage_;
+    bool active_ = false;
+    uint64_t bytes_ = 0;
+    int64_t start_ns_ = 0;
+};
+
+// Log-linear histogram of durations: 8 buckets per power of two, so
+// percentiles are within ~6%, in constant memory however many samples it holds
+class LatencyHistogram {
+public:
+    static constexpr int kSubBuckets = 8;
+    static constexpr int kNumBuckets = 62 * kSubBuckets;
+
+    void add(int64_t ns);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return count_; }
+    int64_t max_ns() const { return max_ns_; }
+
+    // Nearest rank, reported at the bucket midpoint capped at the maximum; p in [0, 1]
+    double percentile_ns(double p) const;
+
+private:
+    std::array<uint64_t, kNumBuckets> buckets_{};
+    uint64_t count_ = 0;
+    int64_t max_ns_ = 0;
+};
+
+struct StageProfile {
+    uint64_t count = 0;
+    double total_ms = 0.0;
+    double p50_us = 0.0, p95_us = 0.0, p99_us = 0.0, max_us = 0.0;
+    uint64_t bytes = 0;  // allocated inside the stage, summed over all calls
+};
+
+struct ProfileReport {
+    std::array<StageProfile, kNumStages> stages;
+    double wall_s = 0.0;        // since enable_profiling / reset_profile
+    uint64_t dropped_events = 0;  // trace events over the per-thread limit
+};
+
+// Merges every thread's samples. Call after the timed threads have finished.
+ProfileReport collect_profile();
+
+// "[PROFILE]" table on stdout
+void print_profile(const ProfileReport& report);
+
+// Per-stage summary as JSON; the stream version writes one object without a
+// trailing newline, with every line after the first prefixed by indent
+bool write_profile_json(const std::string& path, const ProfileReport& report);
+void write_profile_json(std::ostream& os, const ProfileReport& report, const std::string& indent);
+
+// Trace events in Chrome trace format (chrome://tracing, Perfetto)
+bool write_chrome_trace(const std::string& path);
+
+#endif // PROFILER_HPP
@@ -0,0 +1,58 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <string>
+#include "detector.hpp"
+#include "tracker.hpp"
+#include "writer.hpp"
+
+struct StreamOptions {
+    // Video file, camera index ("0") or capture URL/device path (rtsp://..., /dev/video0)
+    std::string source;
+
+    // A frame that has waited longer than this since capture when the detector
+    // becomes free is skipped instead of processed. <= 0 disables the check.
+    double latency_budget_ms = 100.0;
+
+    // Replay video files at their native frame rate so they behave like a
+    // live source. Live sources are always read as fast as they deliver.
+    bool pace_files = true;
+
+    DetectorParams detector;
+
+    // Track vehicles across processed frames and count zone crossings
+    bool track = false;
+    TrackerParams tracker;
+    std::vector<CountingZone> zones;
+
+    // Stop after this many captured frames (0 = until the source ends)
+    long max_frames = 0;
+
+    // Print a line per processed frame; off by default to keep stdout out of the detection loop
+    bool verbose = false;
+
+    // Debug stage images (DebugStage bits) of every debug_every-th captured
+    // frame that is processed, named frame_<index>.jpg and written on
+    // background threads
+    unsigned debug_stages = DEBUG_NONE;
+    int debug_every = 1;
+    std::string debug_gray_dir = "debug_output/gray/";
+    std::string debug_mask_dir = "debug_output/mask/";
+    std::string debug_morph_dir = "debug_output/morph/";
+    WriterOptions writer;
+
+    // Per-frame detections of processed frames. The default empty path means
+    // output/results.jsonl / output/results.bin (output/results/ for txt).
+    ResultsFormat results_format = ResultsFormat::None;
+    std::string results_path;
+};
+
+// Runs the detector on a live source: capture on its own thread, detection on
+// the calling thread, connected by a latest-frame-wins slot. Prints achieved
+// FPS, drop counts and end-to-end latency percentiles when the source ends,
+// plus vehicle and zone totals when tracking.
+// Returns 0 on success, 1 if the source could not be opened or a debug image
+// could not be written.
+int run_stream(const StreamOptions& options);
+
+#endif // STREAM_HPP
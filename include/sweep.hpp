@@ -0,0 +1,35 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <string>
+#include "detector.hpp"
+
+struct SweepOptions {
+    // Sweep specification, one line per swept parameter:
+    //   <param> = v1, v2, v3      explicit values
+    //   <param> = lo:hi:step      numeric range
+    // plus the settings
+    //   mode = grid | random      (default grid)
+    //   samples = N               points drawn in random mode (default 100)
+    //   seed = N                  random mode seed (default 1)
+    //   metric = f1 | map         objective (default f1)
+    std::string spec_path;
+
+    std::string image_dir = "data/images/";
+    std::string ground_truth_path = "data/ground_truth/";
+    std::string output_path;  // best parameters in config format (optional)
+
+    DetectorParams base;  // values of the parameters that are not swept
+    int threads = 1;
+    int top = 10;         // sweep points to print
+};
+
+// Scores every sweep point against the ground truth. Expensive stages run
+// once per distinct value of the parameters that affect them: masks per
+// distinct front end setting (reduced to blob features frame by frame, never
+// stored), blob features per distinct mask + extractor setting. Points that
+// only differ in filter thresholds reuse both and cost one filter pass plus
+// an evaluation. Returns 0 on success.
+int run_sweep(const SweepOptions& options);
+
+#endif // SWEEP_HPP
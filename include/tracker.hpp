@@ -0,0 +1,119 @@
+#ifndef TRACKER_HPP
+#define TRACKER_HPP
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TrackerParams {
+    double min_iou = 0.2;          // IoU with the predicted box that always allows a match
+    double center_gate = 0.5;      // otherwise match if the centers are within this many track diagonals
+    int max_missed = 5;            // frames a track is kept without a detection
+    int min_hits = 3;              // detections before a track counts as a vehicle
+    double velocity_smoothing = 0.5;  // weight of the newest velocity measurement
+    size_t capacity = 1024;        // live tracks; detections beyond it are not tracked
+    int cell_size = 0;             // spatial grid cell in pixels, 0 = median box size of the frame
+};
+
+// A virtual counting line or polygon in image coordinates.
+// Lines count a track once when its center crosses the segment: "forward"
+// from the left-hand to the right-hand side as seen on screen walking from
+// the first point to the second, "backward" the other way.
+// Polygons count entries as forward and exits as backward, once each per track.
+struct CountingZone {
+    enum class Kind { Line, Polygon };
+
+    std::string name;  // e.g. the lane
+    Kind kind = Kind::Line;
+    std::vector<cv::Point2f> points;
+};
+
+constexpr size_t kMaxCountingZones = 64;
+
+// Reads "<name> = line x1 y1 x2 y2" and "<name> = polygon x1 y1 x2 y2 x3 y3 ..."
+// lines; '#' starts a comment. Returns false on a malformed file.
+bool load_counting_zones(const std::string& path, std::vector<CountingZone>& zones);
+
+struct ZoneCount {
+    std::string name;
+    CountingZone::Kind kind = CountingZone::Kind::Line;
+    uint64_t forward = 0;   // polygons: entries
+    uint64_t backward = 0;  // polygons: exits
+};
+
+// Multi-object tracker for one camera. Detections are associated with the
+// constant-velocity predictions of the live tracks through uniform spatial
+// hashes sized from the median box, so each detection and each track only
+// looks at the cells within its own reach; one oversized blob widens its own
+// search, not everyone's.
+// Track state lives in fixed-capacity arrays (one per field) and all scratch
+// buffers are reused, so update() does not allocate once warmed up.
+class Tracker {
+public:
+    explicit Tracker(const TrackerParams& params, std::vector<CountingZone> zones = {});
+
+    // Feeds the detections of one frame. Frame numbers must increase; gaps
+    // (skipped frames) are bridged by the velocity prediction.
+    void update(const std::vector<cv::Rect>& boxes, int64_t frame);
+
+    size_t live_tracks() const { return active_.size(); }
+    uint64_t vehicles() const { return confirmed_; }  // tracks that reached min_hits
+    uint64_t untracked() const { return untracked_; } // detections dropped at capacity
+    const std::vector<ZoneCount>& counts() const { return counts_; }
+
+private:
+    void predict(int64_t frame);
+    void collect_candidates(const std::vector<cv::Rect>& boxes);
+    void consider(uint32_t t, uint32_t d, const cv::Rect& box);
+    void update_track(uint32_t t, const cv::Rect& box, int64_t frame);
+    void spawn_track(const cv::Rect& box, int64_t frame);
+    void cross_zones(uint32_t t, float x0, float y0, float x1, float y1);
+    void count(uint32_t t, size_t zone, bool forward);
+    void confirm(uint32_t t);
+
+    TrackerParams params_;
+    std::vector<CountingZone> zones_;
+    std::vector<ZoneCount> counts_;
+    uint64_t confirmed_ = 0;
+    uint64_t untracked_ = 0;
+
+    // Track pool, indexed by slot
+    std::vector<float> cx_, cy_, w_, h_;  // last measured center and size
+    std::vector<float> vx_, vy_;          // pixels per frame
+    std::vector<float> px_, py_;          // predicted center for the current frame
+    std::vector<int64_t> last_frame_;
+    std::vector<uint32_t> hits_;
+    std::vector<uint64_t> inside_;        // polygon membership, one bit per zone
+    std::vector<uint64_t> counted_fwd_, counted_bwd_;
+    std::vector<uint64_t> pending_fwd_, pending_bwd_;  // crossings before confirmation
+    std::vector<uint32_t> stamp_;         // candidate de-duplication
+    std::vector<uint32_t> active_, free_;
+
+    // Spatial hash: items counting-sorted into buckets by the cell of their center
+    struct Grid {
+        std::vector<uint32_t> start, fill, items;
+        std::vector<uint32_t> bucket;  // per item id
+    };
+    float cell_ = 1.0f;
+    Grid track_grid_;      // predicted track centers, item = slot
+    Grid detection_grid_;  // detection centers, item = detection index
+    std::vector<float> sizes_;  // median scratch
+    std::vector<float> det_x_, det_y_, det_reach_;  // per detection
+    std::vector<uint32_t> detection_stamp_;
+    uint32_t query_ = 0, detection_query_ = 0;
+
+    struct Candidate {
+        float score;
+        uint32_t track;
+        uint32_t detection;
+    };
+    std::vector<Candidate> candidates_;
+    std::vector<uint8_t> track_matched_, detection_matched_;
+    std::vector<uint32_t> survivors_;
+};
+
+// "[TRACK]" summary: distinct vehicles and per-zone, per-direction totals
+void print_tracking_summary(const std::string& label, const Tracker& tracker);
+
+#endif // TRACKER_HPP
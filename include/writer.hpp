@@ -0,0 +1,131 @@
+#ifndef WRITER_HPP
+#define WRITER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.hpp"
+
+// Debug stages that can be dumped next to the annotated output (bit flags)
+enum DebugStage : unsigned {
+    DEBUG_NONE  = 0,
+    DEBUG_GRAY  = 1u << 0,
+    DEBUG_MASK  = 1u << 1,
+    DEBUG_MORPH = 1u << 2,
+    DEBUG_ALL   = DEBUG_GRAY | DEBUG_MASK | DEBUG_MORPH
+};
+
+// Parses a comma separated list such as "gray,morph", "all" or "none".
+// Returns false on an unknown stage name.
+bool parse_debug_stages(const std::string& list, unsigned& stages);
+
+struct WriterOptions {
+    int threads = 1;
+    size_t queue_capacity = 64;
+};
+
+// Encodes and writes images on background threads.
+// write() blocks while the queue is full, so a slow disk throttles the
+// producers instead of buffering frames without bound.
+class AsyncImageWriter {
+public:
+    explicit AsyncImageWriter(const WriterOptions& options);
+    ~AsyncImageWriter();
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    // The image is shared, not copied; the caller must not modify it afterwards.
+    void write(std::string path, cv::Mat image);
+
+    // Writes everything still queued and stops the workers. Called by the destructor.
+    void finish();
+
+    int failures() const { return failures_.load(); }
+
+private:
+    struct Job {
+        std::string path;
+        cv::Mat image;
+    };
+
+    void worker();
+
+    BoundedQueue<Job> queue_;
+    std::vector<std::thread> workers_;
+    std::atomic<int> failures_{0};
+};
+
+enum class ResultsFormat {
+    None,          // do not write results
+    PerFrameText,  // one "<name>.txt" per frame in a directory (legacy layout)
+    JsonLines,     // one JSON object per frame in a single file
+    Binary         // compact append-only records in a single file, see ResultsSink
+};
+
+// Parses "none", "txt", "jsonl" or "bin". Returns false on anything else.
+bool parse_results_format(const std::string& name, ResultsFormat& format);
+
+// Where ResultsSink writes `format`: `path` when set, otherwise txt_dir for
+// PerFrameText and output/results.jsonl / output/results.bin for the files.
+std::string results_path_for(ResultsFormat format, const std::string& path,
+                             const std::string& txt_dir = "output/results/");
+
+// Append-only sink for per-frame detections. Safe to call from several threads.
+//
+// JsonLines and Binary buffer records in memory and write them out in large
+// batches, so millions of frames end up as one file instead of millions.
+//
+// Binary layout (host byte order):
+//   header: char magic[4] = "VCRS", uint32 version = 1
+//   record: uint64 frame_id, int64 timestamp_us, uint16 name_len, char name[name_len],
+//           uint32 n_boxes, n_boxes * { int32 x, y, width, height }
+class ResultsSink {
+public:
+    // For PerFrameText, path is the output directory; otherwise the output file.
+    ResultsSink(ResultsFormat format, const std::string& path, size_t flush_bytes = 1 << 20);
+    ~ResultsSink();
+
+    ResultsSink(const ResultsSink&) = delete;
+    ResultsSink& operator=(const ResultsSink&) = delete;
+
+    bool is_open() const { return open_; }
+
+    // Returns false if the record could not be written.
+    bool append(uint64_t frame_id, int64_t timestamp_us, const std::string& name,
+                const std::vector<cv::Rect>& boxes);
+
+    // Returns false if buffered records could not be written.
+    bool flush();
+
+private:
+    void flush_locked();
+
+    ResultsFormat format_;
+    std::string path_;
+    size_t flush_bytes_;
+    bool open_ = false;
+    std::ofstream file_;
+    std::string buffer_;
+    std::mutex mutex_;
+};
+
+// One record as read back from a JsonLines or Binary results file
+struct FrameResult {
+    uint64_t frame_id = 0;
+    int64_t timestamp_us = 0;
+    std::string name;
+    std::vector<cv::Rect> boxes;
+};
+
+// Reads a results file written by ResultsSink; the format is detected from
+// the binary magic. Returns false if the file cannot be read or is malformed.
+bool read_results(const std::string& path, std::vector<FrameResult>& frames);
+
+#endif // WRITER_HPP
@@ -1,74 +1,236 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <string>
-#include <vector>
-#include <opencv2/opencv.hpp>
-#include "detector.hpp"
+#include <thread>
+#include "evaluate.hpp"
+#include "pipeline.hpp"
+#include "profiler.hpp"
+#include "stream.hpp"
+#include "sweep.hpp"
 
-#if defined(__cpp_lib_filesystem)
-    #include <filesystem>
-    namespace fs = std::filesystem;
-#elif __has_include(<experimental/filesystem>)
-    #include <experimental/filesystem>
-    namespace fs = std::experimental::filesystem;
-#else
-    #error "No filesystem support"
-#endif
+static void print_usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]\n"
+              << "       " << prog << " evaluate [--gt PATH] [--pred PATH] [--csv FILE] [--threads N]\n"
+              << "                 [--overlay DIR [--images DIR]]\n"
+              << "       " << prog << " sweep --spec FILE [--config FILE] [--images DIR] [--gt PATH] [--out FILE]\n"
+              << "                 [--threads N] [--top N]\n"
+              << "  --config FILE         load detector parameters (key = value lines); later options override it\n"
+              << "  --threads N           worker threads for the batch pipeline (default: all cores)\n"
+              << "  --stream SOURCE       run on a video file, camera index or capture URL instead of data/images/\n"
+              << "  --latency-budget MS   skip stream frames older than MS when detection starts (default: 100, 0 = off)\n"
+              << "  --no-pacing           read stream video files as fast as possible instead of at their frame rate\n"
+              << "  --max-frames N        stop the stream after N captured frames\n"
+              << "  --verbose             print a line for every processed stream frame\n"
+              << "  --front-end MODE      opencv (default) or fused (strip-wise SIMD front end)\n"
+              << "  --fg-threshold N      fused front end foreground threshold (default: 25)\n"
+              << "  --verify-front-end T  run both front ends, report frames whose masks differ on more than fraction T\n"
+              << "  --pyramid-level N     detect at 1/2^N resolution and refine boxes at full resolution (default: 0)\n"
+              << "  --blobs MODE          blob extraction: contours (default, original path) or components\n"
+              << "  --writer-threads N    background JPEG encode/write threads (default: --threads)\n"
+              << "  --debug-stages LIST   debug images to write: gray,mask,morph, all or none (default: none)\n"
+              << "  --debug-every N       write debug images for every Nth frame of each image stream, or every\n"
+              << "                        Nth captured frame with --stream (default: 1)\n"
+              << "  --results-format F    txt (one file per frame), jsonl, bin or none (default: txt; none for streams)\n"
+              << "  --results-path PATH   results directory (txt) or file (jsonl/bin)\n"
+              << "  --track               track vehicles over time and report distinct vehicle counts\n"
+              << "  --lines FILE          count tracks crossing the lines/polygons in FILE (implies --track)\n"
+              << "  --min-hits N          detections before a track counts as a vehicle (default: 3)\n"
+              << "  --max-missed N        frames a track survives without a detection (default: 5)\n"
+              << "  --profile FILE        time every stage and write p50/p95/p99 and allocated bytes as JSON\n"
+              << "  --trace FILE          also write every timed stage in Chrome trace format\n"
+              << "  -h, --help            show this message\n";
+}
 
-int main() {
-    std::string image_dir = "data/images/";
-    std::string output_img_dir = "output/images/";
-    std::string output_txt_dir = "output/results/";
-    std::string debug_gray_dir = "debug_output/gray/";
-    std::string debug_mask_dir = "debug_output/mask/";
-    std::string debug_morph_dir = "debug_output/morph/";
+static int evaluate_command(int argc, char** argv) {
+    EvaluateOptions options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
 
-    fs::create_directories(output_img_dir);
-    fs::create_directories(output_txt_dir);
-    fs::create_directories(debug_gray_dir);
-    fs::create_directories(debug_mask_dir);
-    fs::create_directories(debug_morph_dir);
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--gt" && i + 1 < argc) {
+            options.ground_truth_path = argv[++i];
+        } else if (arg == "--pred" && i + 1 < argc) {
+            options.predictions_path = argv[++i];
+        } else if (arg == "--csv" && i + 1 < argc) {
+            options.csv_path = argv[++i];
+        } else if (arg == "--overlay" && i + 1 < argc) {
+            options.overlay_dir = argv[++i];
+        } else if (arg == "--images" && i + 1 < argc) {
+            options.image_dir = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
 
-    for (const auto& entry : fs::directory_iterator(image_dir)) {
-        std::string img_path = entry.path().string();
-        std::string filename = entry.path().stem().string();
+    return run_evaluate(options);
+}
 
-        cv::Mat image = cv::imread(img_path);
-        if (image.empty()) {
-            std::cerr << "Failed to load image: " << img_path << std::endl;
-            continue;
+static int sweep_command(int argc, char** argv) {
+    SweepOptions options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--spec" && i + 1 < argc) {
+            options.spec_path = argv[++i];
+        } else if (arg == "--config" && i + 1 < argc) {
+            if (!load_detector_params(argv[++i], options.base)) return 1;
+        } else if (arg == "--images" && i + 1 < argc) {
+            options.image_dir = argv[++i];
+        } else if (arg == "--gt" && i + 1 < argc) {
+            options.ground_truth_path = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.output_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--top" && i + 1 < argc) {
+            options.top = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
         }
+    }
+    if (options.spec_path.empty()) {
+        std::cerr << "sweep requires --spec FILE" << std::endl;
+        return 1;
+    }
 
-        // Pass-by-reference debug mats
-        cv::Mat gray, mask, morph;
-        std::vector<cv::Rect> car_boxes = detect_vehicles(image.clone(), gray, mask, morph);
+    return run_sweep(options);
+}
 
-        for (const auto& box : car_boxes) {
-            cv::rectangle(image, box, cv::Scalar(0, 255, 0), 2);
-            cv::putText(image, "car", {box.x, box.y - 5}, cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1);
-        }
+// Prints the stage table and writes the requested profile files
+static int finish_profile(const std::string& profile_path, const std::string& trace_path) {
+    disable_profiling();
+    ProfileReport report = collect_profile();
+    print_profile(report);
+    bool ok = true;
+    if (!profile_path.empty()) ok = write_profile_json(profile_path, report) && ok;
+    if (!trace_path.empty()) ok = write_chrome_trace(trace_path) && ok;
+    return ok ? 0 : 1;
+}
 
-        // Save output image
-        cv::imwrite(output_img_dir + filename + ".jpg", image);
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "evaluate") return evaluate_command(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "sweep") return sweep_command(argc, argv);
 
-        // Save output text file
-        std::ofstream ofs(output_txt_dir + filename + ".txt");
-        if (!ofs) {
-            std::cerr << "Failed to write to file: " << output_txt_dir + filename + ".txt" << std::endl;
-            continue;
-        }
-        for (const auto& box : car_boxes) {
-            ofs << "car " << box.x << " " << box.y << " " << box.width << " " << box.height << "\n";
+    BatchOptions options;
+    StreamOptions stream_options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+    int writer_threads = 0;
+    bool results_format_set = false;
+    std::string profile_path, trace_path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--config" && i + 1 < argc) {
+            if (!load_detector_params(argv[++i], options.detector)) return 1;
+        } else if (arg == "--stream" && i + 1 < argc) {
+            stream_options.source = argv[++i];
+        } else if (arg == "--latency-budget" && i + 1 < argc) {
+            stream_options.latency_budget_ms = std::atof(argv[++i]);
+        } else if (arg == "--no-pacing") {
+            stream_options.pace_files = false;
+        } else if (arg == "--max-frames" && i + 1 < argc) {
+            stream_options.max_frames = std::atol(argv[++i]);
+        } else if (arg == "--verbose") {
+            stream_options.verbose = true;
+        } else if (arg == "--front-end" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "opencv") options.detector.front_end = FrontEnd::OpenCV;
+            else if (mode == "fused") options.detector.front_end = FrontEnd::Fused;
+            else {
+                std::cerr << "Unknown front end: " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--fg-threshold" && i + 1 < argc) {
+            if (!set_detector_param(options.detector, "fg_threshold", argv[++i])) {
+                std::cerr << "Foreground threshold must be 0..255: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--verify-front-end" && i + 1 < argc) {
+            options.detector.verify_tolerance = std::atof(argv[++i]);
+        } else if (arg == "--pyramid-level" && i + 1 < argc) {
+            if (!set_detector_param(options.detector, "pyramid_level", argv[++i])) {
+                std::cerr << "Pyramid level must be 0.." << kMaxPyramidLevel << ": " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--blobs" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "components") options.detector.blob_extractor = BlobExtractor::Components;
+            else if (mode == "contours") options.detector.blob_extractor = BlobExtractor::Contours;
+            else {
+                std::cerr << "Unknown blob extractor: " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--writer-threads" && i + 1 < argc) {
+            writer_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--debug-stages" && i + 1 < argc) {
+            if (!parse_debug_stages(argv[++i], options.debug_stages)) {
+                std::cerr << "Unknown debug stage list: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--debug-every" && i + 1 < argc) {
+            options.debug_every = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--results-format" && i + 1 < argc) {
+            if (!parse_results_format(argv[++i], options.results_format)) {
+                std::cerr << "Unknown results format: " << argv[i] << std::endl;
+                return 1;
+            }
+            results_format_set = true;
+        } else if (arg == "--results-path" && i + 1 < argc) {
+            options.results_path = argv[++i];
+        } else if (arg == "--track") {
+            options.track = true;
+        } else if (arg == "--lines" && i + 1 < argc) {
+            if (!load_counting_zones(argv[++i], options.zones)) return 1;
+            options.track = true;
+        } else if (arg == "--min-hits" && i + 1 < argc) {
+            options.tracker.min_hits = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--max-missed" && i + 1 < argc) {
+            options.tracker.max_missed = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
         }
-        ofs.close();
+    }
+
+    options.writer.threads = writer_threads > 0 ? writer_threads : options.threads;
 
-        // Save debug stages
-        if (!gray.empty())  cv::imwrite(debug_gray_dir + filename + ".jpg", gray);
-        if (!mask.empty())  cv::imwrite(debug_mask_dir + filename + ".jpg", mask);
-        if (!morph.empty()) cv::imwrite(debug_morph_dir + filename + ".jpg", morph);
+    const bool profiling = !profile_path.empty() || !trace_path.empty();
+    if (profiling) enable_profiling(!trace_path.empty());
 
-        std::cout << "[DEBUG] " << filename << " - Found " << car_boxes.size() << " vehicles\n";
+    int status;
+    if (!stream_options.source.empty()) {
+        if (results_format_set) stream_options.results_format = options.results_format;
+        stream_options.results_path = options.results_path;
+        stream_options.detector = options.detector;
+        stream_options.track = options.track;
+        stream_options.tracker = options.tracker;
+        stream_options.zones = options.zones;
+        stream_options.debug_stages = options.debug_stages;
+        stream_options.debug_every = options.debug_every;
+        stream_options.writer = options.writer;
+        status = run_stream(stream_options);
+    } else {
+        status = run_batch(options) == 0 ? 0 : 1;
     }
 
-    return 0;
+    if (profiling && finish_profile(profile_path, trace_path) != 0) status = 1;
+    return status;
 }
@@ -0,0 +1,69 @@
+// Replaces the global operator new/delete to count heap bytes per thread for
+// the profiler. Linked into the executables only (CMake option
+// VEHICLE_COUNTER_COUNT_ALLOCATIONS), never into vehicle_counter_core, so
+// programs embedding the library keep their own allocator.
+#include "profiler.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// The counter is a plain thread-local add, so it stays on even when
+// profiling is disabled.
+void* allocate(std::size_t size, std::size_t alignment) {
+    profiler_detail::allocated_bytes += size;
+    if (size == 0) size = 1;
+    while (true) {
+        void* p = nullptr;
+        if (alignment <= alignof(std::max_align_t)) {
+            p = std::malloc(size);
+        } else {
+            // aligned_alloc needs a size that is a multiple of the alignment
+            p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        }
+        if (p) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* allocate_nothrow(std::size_t size, std::size_t alignment) noexcept {
+    try {
+        return allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocate(size, 0); }
+void* operator new[](std::size_t size) { return allocate(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, 0); }
+
+void* operator new(std::size_t size, std::align_val_t al) { return allocate(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return allocate(size, static_cast<std::size_t>(al)); }
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(al));
+}
+
+// malloc and aligned_alloc memory are both released with free
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
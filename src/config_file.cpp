@@ -0,0 +1,36 @@
+#include "config_file.hpp"
+#include <fstream>
+#include <iostream>
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool read_config_file(const std::string& path, const std::string& what,
+                      const std::function<bool(const std::string& key, const std::string& value)>& setting) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        std::cerr << "Failed to open " << what << ": " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(ifs, line)) {
+        ++line_no;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        std::string key = eq == std::string::npos ? "" : trim(line.substr(0, eq));
+        std::string value = eq == std::string::npos ? "" : trim(line.substr(eq + 1));
+        if (!setting(key, value)) {
+            std::cerr << path << ":" << line_no << ": invalid " << what << " line: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,54 +1,277 @@
 #include "detector.hpp"
+#include "profiler.hpp"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/bgsegm.hpp>
 #include <opencv2/highgui.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 
-std::vector<cv::Rect> detect_vehicles(const cv::Mat& image,
-                                      cv::Mat& gray,
-                                      cv::Mat& mask,
-                                      cv::Mat& morph) {
-    static cv::Ptr<cv::BackgroundSubtractor> bg_subtractor = cv::createBackgroundSubtractorMOG2();
+namespace {
 
+// Area, aspect ratio and extent only need the bounding box and the blob area,
+// so they run before any convex hull is built.
+bool passes_box_filters(const cv::Rect& rect, double blob_area, const DetectorParams& params,
+                        double min_area, double max_area) {
+    double area = rect.area();
+    if (area < min_area || area > max_area) return false;
+    double aspect_ratio = static_cast<double>(rect.width) / rect.height;
+    if (aspect_ratio < params.min_aspect || aspect_ratio > params.max_aspect) return false;
+    double extent = blob_area / area;
+    if (extent < params.min_extent) return false;
+    return true;
+}
+
+bool passes_solidity_filter(double blob_area, double hull_area, const DetectorParams& params) {
+    if (hull_area <= 0) return false;
+    double solidity = blob_area / hull_area;
+    return solidity >= params.min_solidity;
+}
+
+// Convex hull area of one labeled component, in pixel units so it is directly
+// comparable with the pixel count. The hull of a pixel set is the hull of the
+// outer corners of its leftmost and rightmost pixel in every row.
+double component_hull_area(int label, const cv::Rect& rect, BlobBuffers& buffers) {
+    buffers.hull_points.clear();
+    for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        const int* row = buffers.labels.ptr<int>(y);
+        int left = rect.x;
+        int right = rect.x + rect.width - 1;
+        while (left <= right && row[left] != label) ++left;
+        if (left > right) continue;
+        while (row[right] != label) --right;
+
+        buffers.hull_points.emplace_back(left, y);
+        buffers.hull_points.emplace_back(left, y + 1);
+        buffers.hull_points.emplace_back(right + 1, y);
+        buffers.hull_points.emplace_back(right + 1, y + 1);
+    }
+    if (buffers.hull_points.size() < 3) return 0.0;
+
+    cv::convexHull(buffers.hull_points, buffers.hull);
+    return cv::contourArea(buffers.hull);
+}
+
+// Kernel sizes are given at full resolution; keep them odd and at least 3
+// so the closing still bridges small gaps on reduced levels.
+int kernel_at_level(int size, int level) {
+    if (level <= 0) return std::max(1, size | 1);
+    return std::max(3, (size >> level) | 1);
+}
+
+} // namespace
+
+DetectorParams sanitized_detector_params(DetectorParams params) {
+    params.pyramid_level = std::max(0, std::min(params.pyramid_level, kMaxPyramidLevel));
+    params.fused.kernel_size = kernel_at_level(params.kernel_size, params.pyramid_level);
+    return params;
+}
+
+void area_limits(const DetectorParams& params, double frame_area, double& min_area, double& max_area) {
+    min_area = std::round(params.min_area_frac * frame_area);
+    max_area = std::round(params.max_area_frac * frame_area);
+}
+
+bool accept_blob(const BlobFeatures& blob, const DetectorParams& params, double frame_area) {
+    double min_area, max_area;
+    area_limits(params, frame_area, min_area, max_area);
+    return passes_box_filters(blob.box, blob.area, params, min_area, max_area) &&
+           passes_solidity_filter(blob.area, blob.hull_area, params);
+}
+
+VehicleDetector::VehicleDetector(const DetectorParams& params)
+    : params_(sanitized_detector_params(params)),
+      bg_subtractor_(cv::createBackgroundSubtractorMOG2(params_.mog2_history, params_.mog2_var_threshold)),
+      kernel_(cv::getStructuringElement(cv::MORPH_RECT,
+                                        cv::Size(params_.fused.kernel_size, params_.fused.kernel_size))),
+      fused_(params_.fused) {}
+
+std::vector<cv::Rect> VehicleDetector::detect(const cv::Mat& image,
+                                              cv::Mat& gray,
+                                              cv::Mat& mask,
+                                              cv::Mat& morph) {
     std::vector<cv::Rect> boxes;
 
+    // Steps 0-4
+    compute_mask(image, gray, mask, morph);
+
+    // Step 5: Extract and filter blobs, the same way the parameter sweep scores them
+    extract_blob_features(morph, params_.blob_extractor, blobs_, blob_buffers_, &params_);
+    for (const auto& blob : blobs_) {
+        if (accept_blob(blob, params_, frame_area_)) boxes.push_back(blob.box);
+    }
+
+    // Step 6: Map boxes back to full resolution
+    if (level_ > 0 && !boxes.empty()) refine_boxes(image, boxes);
+
+    return boxes;
+}
+
+void VehicleDetector::compute_mask(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph) {
+    // Step 0: Work on a reduced pyramid level if requested. Frames too small
+    // for the configured level use the deepest one that leaves both sides >= 1.
+    level_ = params_.pyramid_level;
+    while (level_ > 0 && ((image.cols >> level_) < 1 || (image.rows >> level_) < 1)) --level_;
+    const cv::Mat* work = &image;
+    if (level_ > 0) {
+        ScopedTimer timer(Stage::Resize);
+        cv::Size size(image.cols >> level_, image.rows >> level_);
+        cv::resize(image, small_, size, 0, 0, cv::INTER_AREA);
+        work = &small_;
+    }
+    frame_area_ = static_cast<double>(work->cols) * work->rows;
+
+    if (params_.front_end == FrontEnd::Fused) {
+        // Steps 1-4 in a single strip-wise pass
+        {
+            ScopedTimer timer(Stage::FrontEnd);
+            fused_.process(*work, gray, mask, morph);
+        }
+        if (params_.verify_tolerance >= 0) verify_front_end(*work, gray, mask, morph);
+        return;
+    }
+
     // Step 1: Convert to grayscale
-    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    {
+        ScopedTimer timer(Stage::Gray);
+        cv::cvtColor(*work, gray, cv::COLOR_BGR2GRAY);
+    }
 
     // Step 2: Apply background subtraction
-    bg_subtractor->apply(gray, mask);
+    {
+        ScopedTimer timer(Stage::Background);
+        bg_subtractor_->apply(gray, mask);
+    }
 
     // Step 3: Remove shadows (shadow value = 127)
-    cv::threshold(mask, mask, 200, 255, cv::THRESH_BINARY);
+    {
+        ScopedTimer timer(Stage::Threshold);
+        cv::threshold(mask, mask, params_.shadow_threshold, 255, cv::THRESH_BINARY);
+    }
 
     // Step 4: Morphological closing to fill holes and remove noise
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-    cv::morphologyEx(mask, morph, cv::MORPH_CLOSE, kernel);
+    ScopedTimer timer(Stage::Morphology);
+    cv::morphologyEx(mask, morph, cv::MORPH_CLOSE, kernel_);
+}
 
-    // Step 5: Find contours
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(morph, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+void VehicleDetector::background(cv::Mat& bg) {
+    if (params_.front_end == FrontEnd::Fused)
+        bg = fused_.background();
+    else
+        bg_subtractor_->getBackgroundImage(bg);
+    if (!bg.empty() && bg.channels() != 1) cv::cvtColor(bg, bg, cv::COLOR_BGR2GRAY);
+}
 
-    for (const auto& contour : contours) {
-        cv::Rect rect = cv::boundingRect(contour);
-        double area = rect.area();
-        double contour_area = cv::contourArea(contour);
+void extract_blob_features(const cv::Mat& morph, BlobExtractor extractor,
+                           std::vector<BlobFeatures>& blobs, BlobBuffers& buffers,
+                           const DetectorParams* prefilter) {
+    blobs.clear();
+    double min_area = 0, max_area = 0;
+    if (prefilter) area_limits(*prefilter, static_cast<double>(morph.total()), min_area, max_area);
+    auto keep = [&](const BlobFeatures& blob) {
+        return !prefilter || passes_box_filters(blob.box, blob.area, *prefilter, min_area, max_area);
+    };
 
-        // Filtering
-        if (area < 1200 || area > 100000) continue;
-        double aspect_ratio = static_cast<double>(rect.width) / rect.height;
-        if (aspect_ratio < 0.4 || aspect_ratio > 4.0) continue;
-        double extent = contour_area / area;
-        if (extent < 0.35) continue;
+    if (extractor == BlobExtractor::Contours) {
+        {
+            ScopedTimer timer(Stage::Blobs);
+            buffers.contours.clear();
+            cv::findContours(morph, buffers.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        }
+        ScopedTimer timer(Stage::Filter);
+        for (const auto& contour : buffers.contours) {
+            BlobFeatures blob;
+            blob.box = cv::boundingRect(contour);
+            blob.area = cv::contourArea(contour);
+            if (!keep(blob)) continue;
+            cv::convexHull(contour, buffers.hull);
+            blob.hull_area = cv::contourArea(buffers.hull);
+            blobs.push_back(blob);
+        }
+        return;
+    }
 
-        std::vector<cv::Point> hull;
-        cv::convexHull(contour, hull);
-        double hull_area = cv::contourArea(hull);
-        if (hull_area <= 0) continue;
-        double solidity = contour_area / hull_area;
-        if (solidity < 0.6) continue;
+    // One labeling pass gives bbox and pixel count for every blob; the output
+    // Mats are reused, so they are only reallocated when the frame size changes.
+    int n_labels = 0;
+    {
+        ScopedTimer timer(Stage::Blobs);
+        n_labels = cv::connectedComponentsWithStats(morph, buffers.labels, buffers.stats, buffers.centroids, 8, CV_32S);
+    }
+    ScopedTimer timer(Stage::Filter);
+    for (int label = 1; label < n_labels; ++label) {  // label 0 is the background
+        const int* stat = buffers.stats.ptr<int>(label);
+        BlobFeatures blob;
+        blob.box = cv::Rect(stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP],
+                            stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]);
+        blob.area = stat[cv::CC_STAT_AREA];
+        // Noise blobs are rejected here, the hull is built only for survivors
+        if (!keep(blob)) continue;
+        blob.hull_area = component_hull_area(label, blob.box, buffers);
+        blobs.push_back(blob);
+    }
+}
 
-        boxes.push_back(rect);
+// Runs the OpenCV front end next to the fused one and reports disagreement.
+// Gray and closing must match exactly (gray within rounding); the background
+// models differ, so the final masks only have to agree within the tolerance.
+void VehicleDetector::verify_front_end(const cv::Mat& image, const cv::Mat& gray,
+                                       const cv::Mat& mask, const cv::Mat& morph) {
+    cv::cvtColor(image, ref_gray_, cv::COLOR_BGR2GRAY);
+    bg_subtractor_->apply(ref_gray_, ref_mask_);
+    cv::threshold(ref_mask_, ref_mask_, params_.shadow_threshold, 255, cv::THRESH_BINARY);
+    cv::morphologyEx(ref_mask_, ref_morph_, cv::MORPH_CLOSE, kernel_);
+    ++verified_frames_;
+
+    double gray_diff = cv::norm(gray, ref_gray_, cv::NORM_INF);
+
+    cv::morphologyEx(mask, ref_closed_, cv::MORPH_CLOSE, kernel_);
+    double closing_diff = cv::norm(morph, ref_closed_, cv::NORM_INF);
+
+    cv::compare(morph, ref_morph_, ref_closed_, cv::CMP_NE);
+    double mismatch = static_cast<double>(cv::countNonZero(ref_closed_)) / std::max<size_t>(1, morph.total());
+
+    if (gray_diff > 1 || closing_diff > 0 || mismatch > params_.verify_tolerance) {
+        std::cerr << "[VERIFY] frame " << verified_frames_ << ": gray max diff " << gray_diff
+                  << ", closing max diff " << closing_diff
+                  << ", mask mismatch " << mismatch * 100.0 << "%" << std::endl;
     }
+}
 
-    return boxes;
+void VehicleDetector::refine_boxes(const cv::Mat& image, std::vector<cv::Rect>& boxes) {
+    ScopedTimer timer(Stage::Refine);
+    background(small_bg_);
+    for (auto& box : boxes)
+        box = refine_box(image, small_bg_, box, level_, params_.refine_threshold, refine_);
+}
+
+// The window's gray pixels are compared with the upsampled background estimate.
+cv::Rect refine_box(const cv::Mat& image, const cv::Mat& background, const cv::Rect& box,
+                    int level, int threshold, RefineBuffers& buffers) {
+    if (level <= 0) return box;
+    const int scale = 1 << level;
+    cv::Rect mapped(box.x * scale, box.y * scale, box.width * scale, box.height * scale);
+    if (background.empty()) return mapped;
+
+    // One low-resolution pixel of margin on every side. The window is clipped
+    // in whole low-resolution pixels that map inside the image, so the full
+    // resolution window is exactly the small one scaled and every background
+    // pixel is upsampled by the same factor, edge windows included.
+    const cv::Rect small_bounds(0, 0, std::min(background.cols, image.cols / scale),
+                                std::min(background.rows, image.rows / scale));
+    cv::Rect small_roi = cv::Rect(box.x - 1, box.y - 1, box.width + 2, box.height + 2) & small_bounds;
+    if (small_roi.empty()) return mapped;
+    const cv::Rect roi(small_roi.x * scale, small_roi.y * scale, small_roi.width * scale, small_roi.height * scale);
+
+    cv::cvtColor(image(roi), buffers.gray, cv::COLOR_BGR2GRAY);
+    cv::resize(background(small_roi), buffers.background, roi.size(), 0, 0, cv::INTER_LINEAR);
+    cv::absdiff(buffers.gray, buffers.background, buffers.diff);
+    cv::threshold(buffers.diff, buffers.diff, threshold, 255, cv::THRESH_BINARY);
+
+    cv::Rect refined = cv::boundingRect(buffers.diff);
+    refined.x += roi.x;
+    refined.y += roi.y;
+
+    // Sparse or missing full-resolution foreground: keep the scaled box
+    return refined.area() * 2 >= mapped.area() ? refined : mapped;
 }
@@ -1,71 +1,101 @@
 // File: src/evaluate.cpp
 #include "evaluate.hpp"
+#include "parallel_for.hpp"
+#include "writer.hpp"
 #include <tinyxml2.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
-#include <set>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "fs_compat.hpp"
 
 using namespace tinyxml2;
 
-std::vector<BoundingBox> parse_ground_truth_xml(const std::string& xml_path) {
-    std::vector<BoundingBox> boxes;
-    XMLDocument doc;
-    if (doc.LoadFile(xml_path.c_str()) != XML_SUCCESS) return boxes;
+namespace {
+
+int int_attribute(const XMLElement* el, const char* name) {
+    int value = 0;
+    el->QueryIntAttribute(name, &value);
+    return value;
+}
+
+int int_child(const XMLElement* el, const char* name) {
+    int value = 0;
+    const XMLElement* child = el->FirstChildElement(name);
+    if (child) child->QueryIntText(&value);
+    return value;
+}
 
-    XMLElement* root = doc.FirstChildElement("annotation");
-    for (XMLElement* obj = root->FirstChildElement("object"); obj; obj = obj->NextSiblingElement("object")) {
-        const char* label = obj->FirstChildElement("name")->GetText();
-        XMLElement* box = obj->FirstChildElement("bndbox");
+// Pascal VOC <annotation> element
+std::vector<BoundingBox> parse_voc_annotation(const XMLElement* root) {
+    std::vector<BoundingBox> boxes;
+    for (const XMLElement* obj = root->FirstChildElement("object"); obj; obj = obj->NextSiblingElement("object")) {
+        const XMLElement* name = obj->FirstChildElement("name");
+        const XMLElement* box = obj->FirstChildElement("bndbox");
+        const char* label = name ? name->GetText() : nullptr;
         if (!label || !box) continue;
 
         BoundingBox b;
         b.label = label;
-        box->FirstChildElement("xmin")->QueryIntText(&b.x);
-        box->FirstChildElement("ymin")->QueryIntText(&b.y);
-        int xmax, ymax;
-        box->FirstChildElement("xmax")->QueryIntText(&xmax);
-        box->FirstChildElement("ymax")->QueryIntText(&ymax);
-        b.width = xmax - b.x;
-        b.height = ymax - b.y;
+        b.x = int_child(box, "xmin");
+        b.y = int_child(box, "ymin");
+        b.width = int_child(box, "xmax") - b.x;
+        b.height = int_child(box, "ymax") - b.y;
         boxes.push_back(b);
     }
     return boxes;
 }
 
-double compute_iou(const BoundingBox& a, const cv::Rect& b) {
-    cv::Rect ra(a.x, a.y, a.width, a.height);
-    int x1 = std::max(ra.x, b.x);
-    int y1 = std::max(ra.y, b.y);
-    int x2 = std::min(ra.x + ra.width, b.x + b.width);
-    int y2 = std::min(ra.y + ra.height, b.y + b.height);
-
-    int interArea = std::max(0, x2 - x1) * std::max(0, y2 - y1);
-    int unionArea = ra.area() + b.area() - interArea;
-    return unionArea > 0 ? static_cast<double>(interArea) / unionArea : 0.0;
+std::string stem_of(const std::string& filename) {
+    return fs::path(filename).stem().string();
 }
 
-EvaluationResult evaluate_predictions(const std::vector<BoundingBox>& gt_boxes,
-                                      const std::vector<cv::Rect>& pred_boxes) {
-    EvaluationResult result;
-    result.n_true = gt_boxes.size();
-    result.n_pred = pred_boxes.size();
-    std::set<int> matched_preds;
-
-    for (const auto& gt : gt_boxes) {
-        bool matched = false;
-        for (size_t j = 0; j < pred_boxes.size(); ++j) {
-            if (matched_preds.count(j)) continue;
-            double iou = compute_iou(gt, pred_boxes[j]);
-            if (iou >= 0.5) {
-                matched_preds.insert(j);
-                matched = true;
-                break;
-            }
+// Adds the images of one XML file to the index. Merged <dataset> files are
+// only accepted when allow_merged is set, so a directory scan does not count
+// every image twice.
+bool load_xml_file(const std::string& path, GroundTruthIndex& index, bool allow_merged) {
+    XMLDocument doc;
+    if (doc.LoadFile(path.c_str()) != XML_SUCCESS) {
+        std::cerr << "Failed to parse ground truth: " << path << std::endl;
+        return false;
+    }
+
+    if (const XMLElement* root = doc.FirstChildElement("annotation")) {
+        const XMLElement* filename = root->FirstChildElement("filename");
+        const char* text = filename ? filename->GetText() : nullptr;
+        index[stem_of(text ? text : path)] = parse_voc_annotation(root);
+        return true;
+    }
+
+    const XMLElement* dataset = doc.FirstChildElement("dataset");
+    if (!dataset || !allow_merged) return false;
+    for (const XMLElement* image = dataset->FirstChildElement("image"); image; image = image->NextSiblingElement("image")) {
+        const char* filename = image->Attribute("filename");
+        if (!filename) continue;
+        std::vector<BoundingBox>& boxes = index[stem_of(filename)];
+        boxes.clear();
+        for (const XMLElement* obj = image->FirstChildElement("object"); obj; obj = obj->NextSiblingElement("object")) {
+            const char* label = obj->Attribute("name");
+            BoundingBox b;
+            b.label = label ? label : "car";
+            b.x = int_attribute(obj, "xmin");
+            b.y = int_attribute(obj, "ymin");
+            b.width = int_attribute(obj, "xmax") - b.x;
+            b.height = int_attribute(obj, "ymax") - b.y;
+            boxes.push_back(b);
         }
-        if (matched) result.tp++;
-        else result.fn++;
     }
+    return true;
+}
 
+void finalize(EvaluationResult& result) {
     result.fp = result.n_pred - result.tp;
+    result.fn = result.n_true - result.tp;
 
     result.precision = result.n_pred > 0 ? static_cast<double>(result.tp) / result.n_pred : 0;
     result.recall = result.n_true > 0 ? static_cast<double>(result.tp) / result.n_true : 0;
@@ -75,6 +105,416 @@ EvaluationResult evaluate_predictions(const std::vector<BoundingBox>& gt_boxes,
 
     result.abs_error = std::abs(result.n_pred - result.n_true);
     result.rel_error = result.n_true > 0 ? result.abs_error / static_cast<double>(result.n_true) : 0;
+}
+
+// Dense n_gt x n_pred IoU matrix (row-major). Prediction boxes are unpacked
+// into coordinate arrays so the inner loop is branch-free and vectorizes.
+void compute_iou_matrix(const std::vector<BoundingBox>& gt, const std::vector<Prediction>& pred, MatchScratch& s) {
+    const size_t np = pred.size();
+    s.px1.resize(np);
+    s.py1.resize(np);
+    s.px2.resize(np);
+    s.py2.resize(np);
+    s.parea.resize(np);
+    for (size_t j = 0; j < np; ++j) {
+        const cv::Rect& r = pred[j].box;
+        s.px1[j] = static_cast<float>(r.x);
+        s.py1[j] = static_cast<float>(r.y);
+        s.px2[j] = static_cast<float>(r.x + r.width);
+        s.py2[j] = static_cast<float>(r.y + r.height);
+        s.parea[j] = static_cast<float>(r.width) * r.height;
+    }
 
+    s.iou.resize(gt.size() * np);
+    const float* px1 = s.px1.data();
+    const float* py1 = s.py1.data();
+    const float* px2 = s.px2.data();
+    const float* py2 = s.py2.data();
+    const float* parea = s.parea.data();
+    for (size_t i = 0; i < gt.size(); ++i) {
+        const float gx1 = static_cast<float>(gt[i].x);
+        const float gy1 = static_cast<float>(gt[i].y);
+        const float gx2 = static_cast<float>(gt[i].x + gt[i].width);
+        const float gy2 = static_cast<float>(gt[i].y + gt[i].height);
+        const float garea = static_cast<float>(gt[i].width) * gt[i].height;
+        float* row = s.iou.data() + i * np;
+        for (size_t j = 0; j < np; ++j) {
+            float iw = std::max(0.0f, std::min(gx2, px2[j]) - std::max(gx1, px1[j]));
+            float ih = std::max(0.0f, std::min(gy2, py2[j]) - std::max(gy1, py1[j]));
+            float inter = iw * ih;
+            float uni = garea + parea[j] - inter;
+            row[j] = uni > 0.0f ? inter / uni : 0.0f;
+        }
+    }
+}
+
+// Greedy assignment over (gt, pred) pairs ordered by prediction score, then
+// IoU: with equal scores this pairs the most overlapping boxes first instead
+// of the first overlap found. The order is computed once and replayed for
+// first n_thresholds IoU thresholds. tp_flags[t * n_pred + j] is set when
+// prediction j is a true positive at threshold t.
+void match_image(const std::vector<BoundingBox>& gt, const std::vector<Prediction>& pred, int n_thresholds,
+                 MatchScratch& s, std::vector<uint8_t>& tp_flags, int tp_count[kNumIouThresholds]) {
+    const size_t ng = gt.size();
+    const size_t np = pred.size();
+    tp_flags.assign(n_thresholds * np, 0);
+    std::fill(tp_count, tp_count + kNumIouThresholds, 0);
+    if (ng == 0 || np == 0) return;
+
+    compute_iou_matrix(gt, pred, s);
+
+    const float min_iou = static_cast<float>(iou_threshold(0));
+    s.pairs.clear();
+    for (size_t i = 0; i < ng; ++i) {
+        const float* row = s.iou.data() + i * np;
+        for (size_t j = 0; j < np; ++j) {
+            if (row[j] >= min_iou)
+                s.pairs.push_back({pred[j].score, row[j], static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+        }
+    }
+    std::sort(s.pairs.begin(), s.pairs.end(), [](const MatchScratch::Pair& a, const MatchScratch::Pair& b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.iou != b.iou) return a.iou > b.iou;
+        if (a.pred != b.pred) return a.pred < b.pred;
+        return a.gt < b.gt;
+    });
+
+    for (int t = 0; t < n_thresholds; ++t) {
+        const float thr = static_cast<float>(iou_threshold(t));
+        s.gt_used.assign(ng, 0);
+        s.pred_used.assign(np, 0);
+        for (const auto& p : s.pairs) {
+            if (p.iou < thr || s.gt_used[p.gt] || s.pred_used[p.pred]) continue;
+            s.gt_used[p.gt] = 1;
+            s.pred_used[p.pred] = 1;
+            tp_flags[t * np + p.pred] = 1;
+            ++tp_count[t];
+        }
+    }
+}
+
+// All-point interpolated average precision for detections already sorted by
+// descending score. Detections with equal scores have no order among them, so
+// a run of equal scores is one operating point, taken after the whole run.
+// Without scores (every box at the 1.0 fallback) AP is precision * recall.
+double average_precision(const std::vector<float>& sorted_scores, const std::vector<uint8_t>& sorted_tp,
+                         int n_true) {
+    if (n_true == 0 || sorted_tp.empty()) return 0.0;
+    std::vector<double> precision, recall;
+    int tp = 0;
+    for (size_t k = 0; k < sorted_tp.size(); ++k) {
+        tp += sorted_tp[k];
+        if (k + 1 < sorted_tp.size() && sorted_scores[k + 1] == sorted_scores[k]) continue;
+        precision.push_back(static_cast<double>(tp) / (k + 1));
+        recall.push_back(static_cast<double>(tp) / n_true);
+    }
+    const size_t n = precision.size();
+    for (size_t k = n - 1; k > 0; --k) precision[k - 1] = std::max(precision[k - 1], precision[k]);
+
+    double ap = 0.0;
+    double prev_recall = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        ap += (recall[k] - prev_recall) * precision[k];
+        prev_recall = recall[k];
+    }
+    return ap;
+}
+
+} // namespace
+
+std::vector<BoundingBox> parse_ground_truth_xml(const std::string& xml_path) {
+    XMLDocument doc;
+    if (doc.LoadFile(xml_path.c_str()) != XML_SUCCESS) return {};
+
+    const XMLElement* root = doc.FirstChildElement("annotation");
+    if (!root) return {};
+    return parse_voc_annotation(root);
+}
+
+EvaluationResult evaluate_predictions(const std::vector<BoundingBox>& gt_boxes,
+                                      const std::vector<cv::Rect>& pred_boxes) {
+    std::vector<Prediction> preds(pred_boxes.size());
+    for (size_t j = 0; j < pred_boxes.size(); ++j) preds[j].box = pred_boxes[j];
+
+    MatchScratch scratch;
+    std::vector<uint8_t> tp_flags;
+    int tp_count[kNumIouThresholds];
+    match_image(gt_boxes, preds, 1, scratch, tp_flags, tp_count);
+
+    EvaluationResult result;
+    result.n_true = gt_boxes.size();
+    result.n_pred = pred_boxes.size();
+    result.tp = tp_count[0];
+    finalize(result);
     return result;
 }
+
+bool load_ground_truth(const std::string& path, GroundTruthIndex& index) {
+    if (!fs::is_directory(path)) return load_xml_file(path, index, true) && !index.empty();
+
+    for (const auto& entry : fs::directory_iterator(path)) {
+        if (entry.path().extension() != ".xml") continue;
+        load_xml_file(entry.path().string(), index, false);
+    }
+    return !index.empty();
+}
+
+bool load_predictions(const std::string& path, PredictionIndex& index) {
+    if (!fs::is_directory(path)) {
+        std::vector<FrameResult> frames;
+        if (!read_results(path, frames)) {
+            std::cerr << "Failed to read results file: " << path << std::endl;
+            return false;
+        }
+        for (const auto& frame : frames) {
+            std::vector<Prediction>& preds = index[frame.name];
+            preds.clear();
+            for (const auto& box : frame.boxes) preds.push_back({box, 1.0f});
+        }
+        return true;
+    }
+
+    for (const auto& entry : fs::directory_iterator(path)) {
+        if (entry.path().extension() != ".txt") continue;
+        std::ifstream ifs(entry.path().string());
+        if (!ifs) continue;
+        std::vector<Prediction>& preds = index[entry.path().stem().string()];
+        std::string line;
+        while (std::getline(ifs, line)) {
+            std::istringstream ls(line);
+            std::string label;
+            Prediction p;
+            if (!(ls >> label >> p.box.x >> p.box.y >> p.box.width >> p.box.height)) continue;
+            if (!(ls >> p.score)) p.score = 1.0f;
+            preds.push_back(p);
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Shared by evaluate_dataset() and evaluate_images(): gt(i) and preds(i) give
+// image i. The calling thread matches with `scratch`, pool threads with their own.
+template <typename GroundTruthAt, typename PredictionsAt>
+DatasetEvaluation evaluate_ordered(size_t n_images, GroundTruthAt gt_at, PredictionsAt preds_at,
+                                   bool with_ap, int threads, MatchScratch& scratch) {
+    DatasetEvaluation eval;
+    const int n_thresholds = with_ap ? kNumIouThresholds : 1;
+    std::vector<std::vector<uint8_t>> tp_flags(n_images);
+    eval.images.resize(n_images);
+
+    // Images are independent: each worker writes only its own slots
+    std::vector<MatchScratch> pool_scratch(std::max(1, threads) - 1);
+    parallel_for(n_images, threads, [&](size_t i, size_t worker) {
+        MatchScratch& s = worker == 0 ? scratch : pool_scratch[worker - 1];
+        const std::vector<BoundingBox>& gt = gt_at(i);
+        const std::vector<Prediction>& preds = preds_at(i);
+
+        int tp_count[kNumIouThresholds];
+        match_image(gt, preds, n_thresholds, s, tp_flags[i], tp_count);
+
+        ImageEvaluation& image = eval.images[i];
+        image.result.n_true = gt.size();
+        image.result.n_pred = preds.size();
+        image.result.tp = tp_count[0];
+        finalize(image.result);
+    });
+
+    // Totals at IoU 0.5
+    for (const auto& image : eval.images) {
+        eval.total.tp += image.result.tp;
+        eval.total.n_true += image.result.n_true;
+        eval.total.n_pred += image.result.n_pred;
+        eval.mean_abs_error += image.result.abs_error;
+        eval.mean_rel_error += image.result.rel_error;
+    }
+    finalize(eval.total);
+    if (n_images > 0) {
+        eval.mean_abs_error /= n_images;
+        eval.mean_rel_error /= n_images;
+    }
+    if (!with_ap) return eval;
+
+    // AP: rank all detections of the dataset by score once, then walk the
+    // ranking for every IoU threshold
+    struct Ranked {
+        float score;
+        uint32_t image;
+        uint32_t pred;
+    };
+    std::vector<Ranked> ranked;
+    ranked.reserve(eval.total.n_pred);
+    for (size_t i = 0; i < n_images; ++i) {
+        const std::vector<Prediction>& preds = preds_at(i);
+        for (size_t j = 0; j < preds.size(); ++j)
+            ranked.push_back({preds[j].score, static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) { return a.score > b.score; });
+
+    std::vector<float> sorted_scores(ranked.size());
+    for (size_t k = 0; k < ranked.size(); ++k) sorted_scores[k] = ranked[k].score;
+    std::vector<uint8_t> sorted_tp(ranked.size());
+    for (int t = 0; t < kNumIouThresholds; ++t) {
+        for (size_t k = 0; k < ranked.size(); ++k) {
+            const Ranked& r = ranked[k];
+            size_t n_pred = eval.images[r.image].result.n_pred;
+            sorted_tp[k] = tp_flags[r.image][t * n_pred + r.pred];
+        }
+        eval.ap[t] = average_precision(sorted_scores, sorted_tp, eval.total.n_true);
+        eval.map += eval.ap[t];
+    }
+    eval.map /= kNumIouThresholds;
+
+    return eval;
+}
+
+} // namespace
+
+DatasetEvaluation evaluate_dataset(const GroundTruthIndex& ground_truth,
+                                   const PredictionIndex& predictions,
+                                   int threads) {
+    std::vector<std::string> names;
+    names.reserve(ground_truth.size());
+    for (const auto& kv : ground_truth) names.push_back(kv.first);
+    std::sort(names.begin(), names.end());
+
+    std::vector<const std::vector<BoundingBox>*> gt(names.size());
+    std::vector<const std::vector<Prediction>*> preds(names.size());
+    const std::vector<Prediction> no_predictions;
+    for (size_t i = 0; i < names.size(); ++i) {
+        gt[i] = &ground_truth.at(names[i]);
+        auto it = predictions.find(names[i]);
+        preds[i] = it != predictions.end() ? &it->second : &no_predictions;
+    }
+
+    MatchScratch scratch;
+    DatasetEvaluation eval = evaluate_ordered(
+        names.size(), [&](size_t i) -> const std::vector<BoundingBox>& { return *gt[i]; },
+        [&](size_t i) -> const std::vector<Prediction>& { return *preds[i]; }, true, threads, scratch);
+    for (size_t i = 0; i < names.size(); ++i) eval.images[i].name = names[i];
+
+    // Predictions for images without ground truth take no part in the scores
+    for (const auto& kv : predictions) {
+        if (ground_truth.count(kv.first)) continue;
+        ++eval.skipped_images;
+        eval.skipped_predictions += kv.second.size();
+    }
+    return eval;
+}
+
+DatasetEvaluation evaluate_images(const std::vector<const std::vector<BoundingBox>*>& ground_truth,
+                                  const std::vector<std::vector<Prediction>>& predictions,
+                                  bool with_ap, MatchScratch& scratch) {
+    return evaluate_ordered(
+        ground_truth.size(), [&](size_t i) -> const std::vector<BoundingBox>& { return *ground_truth[i]; },
+        [&](size_t i) -> const std::vector<Prediction>& { return predictions[i]; }, with_ap, 1, scratch);
+}
+
+void draw_match_overlay(cv::Mat& image, const std::vector<BoundingBox>& gt,
+                        const std::vector<Prediction>& preds, MatchScratch& scratch) {
+    std::vector<uint8_t> tp_flags;
+    int tp_count[kNumIouThresholds];
+    match_image(gt, preds, 1, scratch, tp_flags, tp_count);
+
+    // gt_used is only filled when the image has both ground truth and predictions
+    const bool matched = !gt.empty() && !preds.empty();
+    for (size_t i = 0; i < gt.size(); ++i) {
+        if (matched && scratch.gt_used[i]) continue;
+        cv::rectangle(image, cv::Rect(gt[i].x, gt[i].y, gt[i].width, gt[i].height), cv::Scalar(255, 0, 0), 2);
+    }
+    for (size_t j = 0; j < preds.size(); ++j) {
+        cv::Scalar color = tp_flags[j] ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255);
+        cv::rectangle(image, preds[j].box, color, 2);
+    }
+}
+
+namespace {
+
+// Writes <overlay_dir>/<name>.jpg for every evaluated image found in
+// image_dir. Returns the number of images that could not be read or written.
+int write_overlays(const EvaluateOptions& options, const DatasetEvaluation& eval,
+                   const GroundTruthIndex& ground_truth, const PredictionIndex& predictions) {
+    fs::create_directories(options.overlay_dir);
+    std::map<std::string, std::string> image_paths;
+    if (fs::is_directory(options.image_dir)) {
+        for (const auto& entry : fs::directory_iterator(options.image_dir)) {
+            if (fs::is_regular_file(entry.path())) image_paths[entry.path().stem().string()] = entry.path().string();
+        }
+    }
+
+    // Decode, draw and encode are independent per image
+    const std::vector<Prediction> no_predictions;
+    std::atomic<int> failures{0};
+    std::vector<MatchScratch> scratch(std::max(1, options.threads));
+    parallel_for(eval.images.size(), options.threads, [&](size_t i, size_t worker) {
+        const std::string& name = eval.images[i].name;
+        auto path = image_paths.find(name);
+        cv::Mat image = path != image_paths.end() ? cv::imread(path->second) : cv::Mat();
+        if (image.empty()) {
+            ++failures;
+            return;
+        }
+        auto preds = predictions.find(name);
+        draw_match_overlay(image, ground_truth.at(name), preds != predictions.end() ? preds->second : no_predictions,
+                           scratch[worker]);
+        if (!cv::imwrite((fs::path(options.overlay_dir) / (name + ".jpg")).string(), image)) ++failures;
+    });
+    return failures.load();
+}
+
+} // namespace
+
+int run_evaluate(const EvaluateOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+
+    GroundTruthIndex ground_truth;
+    if (!load_ground_truth(options.ground_truth_path, ground_truth)) {
+        std::cerr << "No ground truth loaded from " << options.ground_truth_path << std::endl;
+        return 1;
+    }
+    PredictionIndex predictions;
+    if (!load_predictions(options.predictions_path, predictions)) return 1;
+
+    DatasetEvaluation eval = evaluate_dataset(ground_truth, predictions, options.threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const EvaluationResult& t = eval.total;
+    std::cout << "[EVAL] " << eval.images.size() << " images, " << t.n_true << " ground truth, "
+              << t.n_pred << " predicted (" << seconds << " s)\n";
+    std::cout << "[EVAL] IoU 0.5: TP " << t.tp << ", FP " << t.fp << ", FN " << t.fn
+              << ", precision " << t.precision << ", recall " << t.recall << ", F1 " << t.f1 << "\n";
+    std::cout << "[EVAL] count error: mean abs " << eval.mean_abs_error
+              << ", mean rel " << eval.mean_rel_error << "\n";
+    std::cout << "[EVAL] AP50 " << eval.ap[0] << ", AP75 " << eval.ap[5]
+              << ", AP[.5:.95] " << eval.map << "\n";
+    if (eval.skipped_images > 0) {
+        std::cerr << "[EVAL] warning: " << eval.skipped_predictions << " prediction(s) in " << eval.skipped_images
+                  << " image(s) without ground truth were skipped" << std::endl;
+    }
+
+    if (!options.csv_path.empty()) {
+        std::ofstream csv(options.csv_path);
+        if (!csv) {
+            std::cerr << "Failed to write to file: " << options.csv_path << std::endl;
+            return 1;
+        }
+        csv << "image,n_true,n_pred,tp,fp,fn,precision,recall,f1,abs_error,rel_error\n";
+        for (const auto& image : eval.images) {
+            const EvaluationResult& r = image.result;
+            csv << image.name << "," << r.n_true << "," << r.n_pred << "," << r.tp << "," << r.fp << ","
+                << r.fn << "," << r.precision << "," << r.recall << "," << r.f1 << ","
+                << r.abs_error << "," << r.rel_error << "\n";
+        }
+    }
+
+    if (!options.overlay_dir.empty()) {
+        int failures = write_overlays(options, eval, ground_truth, predictions);
+        std::cout << "[EVAL] overlays written to " << options.overlay_dir << " (TP green, FP red, FN blue)\n";
+        if (failures > 0) {
+            std::cerr << failures << " image(s) not found in " << options.image_dir << " or not written" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "frontend.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+namespace {
+
+// Minimal unsigned 8-bit vector layer. simd::lanes == 0 means scalar only.
+namespace simd {
+#if defined(__AVX2__)
+    using v8 = __m256i;
+    constexpr int lanes = 32;
+    inline v8 load(const uchar* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void store(uchar* p, v8 v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline v8 set1(uchar x) { return _mm256_set1_epi8(static_cast<char>(x)); }
+    inline v8 max(v8 a, v8 b) { return _mm256_max_epu8(a, b); }
+    inline v8 min(v8 a, v8 b) { return _mm256_min_epu8(a, b); }
+    inline v8 adds(v8 a, v8 b) { return _mm256_adds_epu8(a, b); }
+    inline v8 subs(v8 a, v8 b) { return _mm256_subs_epu8(a, b); }
+    inline v8 cmpeq(v8 a, v8 b) { return _mm256_cmpeq_epi8(a, b); }
+#elif defined(__SSE2__)
+    using v8 = __m128i;
+    constexpr int lanes = 16;
+    inline v8 load(const uchar* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void store(uchar* p, v8 v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline v8 set1(uchar x) { return _mm_set1_epi8(static_cast<char>(x)); }
+    inline v8 max(v8 a, v8 b) { return _mm_max_epu8(a, b); }
+    inline v8 min(v8 a, v8 b) { return _mm_min_epu8(a, b); }
+    inline v8 adds(v8 a, v8 b) { return _mm_adds_epu8(a, b); }
+    inline v8 subs(v8 a, v8 b) { return _mm_subs_epu8(a, b); }
+    inline v8 cmpeq(v8 a, v8 b) { return _mm_cmpeq_epi8(a, b); }
+#elif defined(__ARM_NEON)
+    using v8 = uint8x16_t;
+    constexpr int lanes = 16;
+    inline v8 load(const uchar* p) { return vld1q_u8(p); }
+    inline void store(uchar* p, v8 v) { vst1q_u8(p, v); }
+    inline v8 set1(uchar x) { return vdupq_n_u8(x); }
+    inline v8 max(v8 a, v8 b) { return vmaxq_u8(a, b); }
+    inline v8 min(v8 a, v8 b) { return vminq_u8(a, b); }
+    inline v8 adds(v8 a, v8 b) { return vqaddq_u8(a, b); }
+    inline v8 subs(v8 a, v8 b) { return vqsubq_u8(a, b); }
+    inline v8 cmpeq(v8 a, v8 b) { return vceqq_u8(a, b); }
+#else
+    constexpr int lanes = 0;
+#endif
+} // namespace simd
+
+inline uchar sat_sub(uchar a, uchar b) { return a > b ? static_cast<uchar>(a - b) : 0; }
+
+// Same fixed-point weights as cv::cvtColor(BGR2GRAY) for 8-bit input.
+// Deinterleaving 3 channels is left to the compiler's auto-vectorizer.
+void bgr_to_gray_row(const uchar* bgr, uchar* gray, int width) {
+    for (int x = 0; x < width; ++x, bgr += 3) {
+        gray[x] = static_cast<uchar>((bgr[0] * 1868 + bgr[1] * 9617 + bgr[2] * 4899 + 8192) >> 14);
+    }
+}
+
+// Classifies one row against the background, then moves the background at
+// most `step` levels towards the current frame (approximate running median).
+void background_row(const uchar* gray, uchar* bg, uchar* fg, int width, uchar threshold, uchar step) {
+    int x = 0;
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    // threshold + 1 wraps to 0 at 255, where nothing is foreground; `keep` clears those lanes
+    const simd::v8 thr1 = simd::set1(static_cast<uchar>(threshold + 1));
+    const simd::v8 keep = simd::set1(threshold == 255 ? 0 : 255);
+    const simd::v8 vstep = simd::set1(step);
+    for (; x + simd::lanes <= width; x += simd::lanes) {
+        simd::v8 g = simd::load(gray + x);
+        simd::v8 b = simd::load(bg + x);
+        simd::v8 up = simd::subs(g, b);
+        simd::v8 down = simd::subs(b, g);
+        simd::v8 diff = simd::max(up, down);
+        // diff > threshold  <=>  max(diff, threshold + 1) == diff
+        simd::store(fg + x, simd::min(simd::cmpeq(simd::max(diff, thr1), diff), keep));
+        b = simd::subs(simd::adds(b, simd::min(up, vstep)), simd::min(down, vstep));
+        simd::store(bg + x, b);
+    }
+#endif
+    for (; x < width; ++x) {
+        uchar up = sat_sub(gray[x], bg[x]);
+        uchar down = sat_sub(bg[x], gray[x]);
+        fg[x] = std::max(up, down) > threshold ? 255 : 0;
+        bg[x] = static_cast<uchar>(bg[x] + std::min(up, step) - std::min(down, step));
+    }
+}
+
+// dst[x] = max (or min) of src over [x - radius, x + radius], ignoring
+// pixels outside the row like OpenCV's default morphology border.
+template <bool IsMax>
+void horizontal_row(const uchar* src, uchar* dst, int width, int radius) {
+    auto pick = [](uchar a, uchar b) { return IsMax ? std::max(a, b) : std::min(a, b); };
+    auto window = [&](int x) {
+        int lo = std::max(0, x - radius);
+        int hi = std::min(width - 1, x + radius);
+        uchar v = src[lo];
+        for (int i = lo + 1; i <= hi; ++i) v = pick(v, src[i]);
+        return v;
+    };
+
+    int x = 0;
+    for (; x < std::min(radius, width); ++x) dst[x] = window(x);
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    for (; x + radius + simd::lanes <= width; x += simd::lanes) {
+        simd::v8 v = simd::load(src + x - radius);
+        for (int i = -radius + 1; i <= radius; ++i) {
+            simd::v8 s = simd::load(src + x + i);
+            v = IsMax ? simd::max(v, s) : simd::min(v, s);
+        }
+        simd::store(dst + x, v);
+    }
+#endif
+    for (; x < width; ++x) dst[x] = window(x);
+}
+
+// dst = element-wise max (or min) of n rows
+template <bool IsMax>
+void vertical_rows(const uchar* const* rows, int n, uchar* dst, int width) {
+    int x = 0;
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    for (; x + simd::lanes <= width; x += simd::lanes) {
+        simd::v8 v = simd::load(rows[0] + x);
+        for (int i = 1; i < n; ++i) {
+            simd::v8 s = simd::load(rows[i] + x);
+            v = IsMax ? simd::max(v, s) : simd::min(v, s);
+        }
+        simd::store(dst + x, v);
+    }
+#endif
+    for (; x < width; ++x) {
+        uchar v = rows[0][x];
+        for (int i = 1; i < n; ++i) v = IsMax ? std::max(v, rows[i][x]) : std::min(v, rows[i][x]);
+        dst[x] = v;
+    }
+}
+
+} // namespace
+
+FusedFrontEnd::FusedFrontEnd(const FusedFrontEndParams& params) : params_(params) {
+    params_.fg_threshold = std::max(0, std::min(params_.fg_threshold, 255));
+    params_.adapt_step = std::max(1, std::min(params_.adapt_step, 255));
+    params_.kernel_size = std::max(1, params_.kernel_size | 1);
+}
+
+void FusedFrontEnd::process(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph) {
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 3 || image.channels() == 1));
+
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const int radius = params_.kernel_size / 2;
+    const uchar threshold = static_cast<uchar>(params_.fg_threshold);
+    const uchar step = static_cast<uchar>(params_.adapt_step);
+
+    if (background_.size() != image.size()) initialized_ = false;
+    gray.create(rows, cols, CV_8UC1);
+    mask.create(rows, cols, CV_8UC1);
+    morph.create(rows, cols, CV_8UC1);
+    background_.create(rows, cols, CV_8UC1);
+    window_.resize(2 * radius + 1);
+
+    // Roughly 9 bytes per pixel are live per row (3 BGR + gray, bg, mask,
+    // hmax, hmin and morph); keep a strip and its halo within ~256 KB of L2.
+    int strip_rows = params_.strip_rows;
+    if (strip_rows <= 0) strip_rows = std::max(8, std::min(64, (256 * 1024) / std::max(1, 9 * cols)));
+
+    // The intermediate passes only keep the rows that are still to be read:
+    // row y lives in ring row y % ring_rows.
+    const int ring_rows = std::min(rows, strip_rows + 2 * radius);
+    hmax_.create(ring_rows, cols, CV_8UC1);
+    hmin_.create(ring_rows, cols, CV_8UC1);
+    dilated_.create(1, cols, CV_8UC1);
+    auto ring = [ring_rows](cv::Mat& m, int y) { return m.ptr<uchar>(y % ring_rows); };
+
+    auto gray_row = [&](int y) {
+        uchar* g = gray.ptr<uchar>(y);
+        if (image.channels() == 3) bgr_to_gray_row(image.ptr<uchar>(y), g, cols);
+        else std::memcpy(g, image.ptr<uchar>(y), cols);
+        return g;
+    };
+
+    // Closing = dilate then erode; both are separable for a rectangular kernel.
+    // Row y of a vertical pass needs rows y +- radius of the previous pass, so
+    // each stage runs ahead of the next by `radius` rows. For the strip
+    // [r0, r1) the vertical max reads hmax rows [r0, r1 + 2 * radius) and the
+    // vertical min reads hmin rows [r0 - radius, r1 + radius), which is why
+    // the rings hold strip_rows + 2 * radius rows.
+    int mask_done = 0;
+    int dilate_done = 0;
+    for (int r0 = 0; r0 < rows; r0 += strip_rows) {
+        const int r1 = std::min(rows, r0 + strip_rows);
+
+        // Gray, background model, threshold, horizontal max
+        const int mask_end = std::min(rows, r1 + 2 * radius);
+        for (int y = mask_done; y < mask_end; ++y) {
+            const uchar* g = gray_row(y);
+            uchar* bg = background_.ptr<uchar>(y);
+            uchar* fg = mask.ptr<uchar>(y);
+            if (!initialized_) {
+                std::memcpy(bg, g, cols);
+                std::memset(fg, 0, cols);
+            } else {
+                background_row(g, bg, fg, cols, threshold, step);
+            }
+            horizontal_row<true>(fg, ring(hmax_, y), cols, radius);
+        }
+        mask_done = mask_end;
+
+        // Vertical max, horizontal min
+        const int dilate_end = std::min(rows, r1 + radius);
+        for (int y = dilate_done; y < dilate_end; ++y) {
+            int lo = std::max(0, y - radius);
+            int hi = std::min(rows - 1, y + radius);
+            for (int i = lo; i <= hi; ++i) window_[i - lo] = ring(hmax_, i);
+            vertical_rows<true>(window_.data(), hi - lo + 1, dilated_.ptr<uchar>(), cols);
+            horizontal_row<false>(dilated_.ptr<uchar>(), ring(hmin_, y), cols, radius);
+        }
+        dilate_done = dilate_end;
+
+        // Vertical min
+        for (int y = r0; y < r1; ++y) {
+            int lo = std::max(0, y - radius);
+            int hi = std::min(rows - 1, y + radius);
+            for (int i = lo; i <= hi; ++i) window_[i - lo] = ring(hmin_, i);
+            vertical_rows<false>(window_.data(), hi - lo + 1, morph.ptr<uchar>(y), cols);
+        }
+    }
+
+    initialized_ = true;
+}
@@ -0,0 +1,118 @@
+#include "detector.hpp"
+#include "config_file.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+bool parse_number(const std::string& value, double& out) {
+    char* end = nullptr;
+    out = std::strtod(value.c_str(), &end);
+    return end != value.c_str() && *end == '\0';
+}
+
+// The value in [lo, hi]; NaN fails every comparison and is rejected too
+bool parse_number(const std::string& value, double lo, double hi, double& out) {
+    double d;
+    if (!parse_number(value, d) || !(d >= lo && d <= hi)) return false;
+    out = d;
+    return true;
+}
+
+// A whole number in [lo, hi], range-checked before the cast to int
+bool parse_int(const std::string& value, int lo, int hi, int& out) {
+    double d;
+    if (!parse_number(value, lo, hi, d) || d != std::floor(d)) return false;
+    out = static_cast<int>(d);
+    return true;
+}
+
+const int kIntMax = std::numeric_limits<int>::max();
+const double kDoubleMax = std::numeric_limits<double>::max();
+
+} // namespace
+
+bool set_detector_param(DetectorParams& params, const std::string& key, const std::string& value) {
+    if (key == "front_end") {
+        if (value == "opencv") params.front_end = FrontEnd::OpenCV;
+        else if (value == "fused") params.front_end = FrontEnd::Fused;
+        else return false;
+        return true;
+    }
+    if (key == "blob_extractor") {
+        if (value == "components") params.blob_extractor = BlobExtractor::Components;
+        else if (value == "contours") params.blob_extractor = BlobExtractor::Contours;
+        else return false;
+        return true;
+    }
+
+    if (key == "fg_threshold") return parse_int(value, 0, 255, params.fused.fg_threshold);
+    if (key == "adapt_step") return parse_int(value, 1, 255, params.fused.adapt_step);
+    if (key == "strip_rows") return parse_int(value, 0, kIntMax, params.fused.strip_rows);
+    if (key == "verify_tolerance") return parse_number(value, -kDoubleMax, kDoubleMax, params.verify_tolerance);
+    if (key == "pyramid_level") return parse_int(value, 0, kMaxPyramidLevel, params.pyramid_level);
+    if (key == "refine_threshold") return parse_int(value, 0, 255, params.refine_threshold);
+    if (key == "mog2_history") return parse_int(value, 1, kIntMax, params.mog2_history);
+    if (key == "mog2_var_threshold") return parse_number(value, 0.0, kDoubleMax, params.mog2_var_threshold);
+    if (key == "shadow_threshold") return parse_int(value, 0, 255, params.shadow_threshold);
+    if (key == "kernel_size") {
+        int size = 0;
+        if (!parse_int(value, 1, kIntMax, size) || size % 2 == 0) return false;
+        params.kernel_size = size;
+        return true;
+    }
+    if (key == "min_area_frac") return parse_number(value, 0.0, 1.0, params.min_area_frac);
+    if (key == "max_area_frac") return parse_number(value, 0.0, 1.0, params.max_area_frac);
+    if (key == "min_aspect") return parse_number(value, 0.0, kDoubleMax, params.min_aspect);
+    if (key == "max_aspect") return parse_number(value, 0.0, kDoubleMax, params.max_aspect);
+    if (key == "min_extent") return parse_number(value, 0.0, kDoubleMax, params.min_extent);
+    if (key == "min_solidity") return parse_number(value, 0.0, kDoubleMax, params.min_solidity);
+    return false;
+}
+
+bool detector_params_consistent(const DetectorParams& params) {
+    return params.min_area_frac <= params.max_area_frac && params.min_aspect <= params.max_aspect;
+}
+
+bool load_detector_params(const std::string& path, DetectorParams& params) {
+    if (!read_config_file(path, "config", [&](const std::string& key, const std::string& value) {
+            return !key.empty() && set_detector_param(params, key, value);
+        }))
+        return false;
+    if (!detector_params_consistent(params)) {
+        std::cerr << path << ": invalid config: min_area_frac or min_aspect above its max" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool save_detector_params(const std::string& path, const DetectorParams& params) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to write to file: " << path << std::endl;
+        return false;
+    }
+    ofs.precision(10);
+    ofs << "front_end = " << (params.front_end == FrontEnd::Fused ? "fused" : "opencv") << "\n"
+        << "fg_threshold = " << params.fused.fg_threshold << "\n"
+        << "adapt_step = " << params.fused.adapt_step << "\n"
+        << "strip_rows = " << params.fused.strip_rows << "\n"
+        << "verify_tolerance = " << params.verify_tolerance << "\n"
+        << "blob_extractor = " << (params.blob_extractor == BlobExtractor::Contours ? "contours" : "components") << "\n"
+        << "pyramid_level = " << params.pyramid_level << "\n"
+        << "refine_threshold = " << params.refine_threshold << "\n"
+        << "mog2_history = " << params.mog2_history << "\n"
+        << "mog2_var_threshold = " << params.mog2_var_threshold << "\n"
+        << "shadow_threshold = " << params.shadow_threshold << "\n"
+        << "kernel_size = " << params.kernel_size << "\n"
+        << "min_area_frac = " << params.min_area_frac << "\n"
+        << "max_area_frac = " << params.max_area_frac << "\n"
+        << "min_aspect = " << params.min_aspect << "\n"
+        << "max_aspect = " << params.max_aspect << "\n"
+        << "min_extent = " << params.min_extent << "\n"
+        << "min_solidity = " << params.min_solidity << "\n";
+    return static_cast<bool>(ofs);
+}
@@ -0,0 +1,312 @@
+#include "pipeline.hpp"
+#include "bounded_queue.hpp"
+#include "detector.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "fs_compat.hpp"
+
+namespace {
+
+struct Frame {
+    size_t id = 0;
+    size_t stream = 0;
+    size_t seq = 0;
+    int64_t timestamp_us = 0;
+    std::string name;
+    cv::Mat image;
+    cv::Mat gray, mask, morph;  // only set on sampled debug frames
+    std::vector<cv::Rect> boxes;
+};
+
+// Per-stream detector and tracker state, owned by exactly one detect worker
+struct StreamState {
+    explicit StreamState(const BatchOptions& options) : detector(options.detector) {
+        if (options.track) tracker = std::make_unique<Tracker>(options.tracker, options.zones);
+    }
+
+    std::string name;
+    VehicleDetector detector;
+    std::unique_ptr<Tracker> tracker;  // only with options.track
+    size_t next_seq = 0;
+    std::map<size_t, Frame> pending;  // decoded out of order, waiting for next_seq
+};
+
+// Keeps decoders within `size` jobs of the oldest job not yet handed to a
+// detect queue. A stalled decode then holds back the others instead of
+// letting every later frame pile up in StreamState::pending.
+class DispatchWindow {
+public:
+    DispatchWindow(size_t n_jobs, size_t size) : done_(n_jobs, 0), size_(std::max<size_t>(1, size)) {}
+
+    // Blocks until job i is inside the window
+    void wait(size_t i) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        moved_.wait(lock, [&] { return i < oldest_ + size_; });
+    }
+
+    void finish(size_t i) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_[i] = 1;
+            while (oldest_ < done_.size() && done_[oldest_]) ++oldest_;
+        }
+        moved_.notify_all();
+    }
+
+private:
+    std::vector<char> done_;
+    const size_t size_;
+    size_t oldest_ = 0;
+    std::mutex mutex_;
+    std::condition_variable moved_;
+};
+
+// Splits "<stream>_<index>" into its parts. Names without a numeric index
+// share the unnamed stream and are ordered by name.
+void split_frame_name(const std::string& stem, std::string& stream, long& index) {
+    size_t pos = stem.rfind('_');
+    bool numeric = pos != std::string::npos && pos + 1 < stem.size() && stem.size() - pos <= 10 &&
+                   std::all_of(stem.begin() + pos + 1, stem.end(),
+                               [](unsigned char c) { return std::isdigit(c) != 0; });
+    if (numeric) {
+        stream = stem.substr(0, pos);
+        index = std::stol(stem.substr(pos + 1));
+    } else {
+        stream.clear();
+        index = -1;
+    }
+}
+
+} // namespace
+
+std::vector<FrameJob> collect_frame_jobs(const std::string& image_dir, size_t& n_streams) {
+    struct Entry {
+        std::string stream;
+        long index;
+        std::string name;
+        std::string path;
+    };
+    std::vector<Entry> entries;
+    for (const auto& entry : fs::directory_iterator(image_dir)) {
+        if (!fs::is_regular_file(entry.path())) continue;
+        Entry e;
+        e.name = entry.path().stem().string();
+        e.path = entry.path().string();
+        split_frame_name(e.name, e.stream, e.index);
+        entries.push_back(std::move(e));
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return std::tie(a.stream, a.index, a.name) < std::tie(b.stream, b.index, b.name);
+    });
+
+    std::vector<FrameJob> jobs;
+    jobs.reserve(entries.size());
+    n_streams = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        bool new_stream = i == 0 || entries[i].stream != entries[i - 1].stream;
+        if (new_stream) ++n_streams;
+        FrameJob job;
+        job.path = entries[i].path;
+        job.name = entries[i].name;
+        job.stream = n_streams - 1;
+        job.seq = new_stream ? 0 : jobs.back().seq + 1;
+        jobs.push_back(std::move(job));
+    }
+
+    std::stable_sort(jobs.begin(), jobs.end(), [](const FrameJob& a, const FrameJob& b) {
+        return std::tie(a.seq, a.stream) < std::tie(b.seq, b.stream);
+    });
+    return jobs;
+}
+
+namespace {
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void annotate_frame(cv::Mat& image, const std::vector<cv::Rect>& boxes) {
+    ScopedTimer timer(Stage::Annotate);
+    for (const auto& box : boxes) {
+        cv::rectangle(image, box, cv::Scalar(0, 255, 0), 2);
+        cv::putText(image, "car", {box.x, box.y - 5}, cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1);
+    }
+}
+
+int run_batch(const BatchOptions& options) {
+    fs::create_directories(options.output_img_dir);
+    if (options.debug_stages & DEBUG_GRAY)  fs::create_directories(options.debug_gray_dir);
+    if (options.debug_stages & DEBUG_MASK)  fs::create_directories(options.debug_mask_dir);
+    if (options.debug_stages & DEBUG_MORPH) fs::create_directories(options.debug_morph_dir);
+
+    ResultsSink results(options.results_format,
+                        results_path_for(options.results_format, options.results_path, options.output_txt_dir));
+    if (!results.is_open()) return 1;
+
+    size_t n_streams = 0;
+    std::vector<FrameJob> jobs = collect_frame_jobs(options.image_dir, n_streams);
+    if (jobs.empty()) {
+        std::cerr << "No images found in " << options.image_dir << std::endl;
+        return 0;
+    }
+
+    const size_t n_threads = static_cast<size_t>(std::max(1, options.threads));
+    const size_t n_detect = std::min(n_threads, n_streams);
+
+    // Several detect workers already keep the cores busy, so split the thread
+    // budget between them instead of letting each OpenCV call fan out over all
+    // cores. A single stream keeps OpenCV's own parallelism for MOG2 and morphology.
+    if (n_detect > 1) cv::setNumThreads(static_cast<int>(std::max<size_t>(1, n_threads / n_detect)));
+
+    std::vector<std::unique_ptr<BoundedQueue<Frame>>> detect_queues;
+    for (size_t i = 0; i < n_detect; ++i)
+        detect_queues.push_back(std::make_unique<BoundedQueue<Frame>>(options.queue_capacity));
+    BoundedQueue<Frame> write_queue(options.queue_capacity);
+    AsyncImageWriter image_writer(options.writer);
+    const size_t debug_every = static_cast<size_t>(std::max(1, options.debug_every));
+
+    std::atomic<size_t> next_job{0};
+    // Decoders stay within a queue's worth of jobs of the oldest undelivered
+    // one, which bounds the frames waiting in the reorder maps
+    DispatchWindow window(jobs.size(), n_threads + options.queue_capacity);
+    std::atomic<int> failures{0};
+    std::mutex log_mutex;
+
+    // Stream states handed over by the detect workers for the tracking summary
+    std::map<size_t, std::unique_ptr<StreamState>> finished_streams;
+
+    // Stage 1: decode
+    auto decode_worker = [&]() {
+        for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+            window.wait(i);
+            const FrameJob& job = jobs[i];
+            Frame frame;
+            frame.id = i;
+            frame.stream = job.stream;
+            frame.seq = job.seq;
+            frame.name = job.name;
+            {
+                ScopedTimer timer(Stage::Decode);
+                frame.image = cv::imread(job.path);
+            }
+            frame.timestamp_us = now_us();
+            if (frame.image.empty()) {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cerr << "Failed to load image: " << job.path << std::endl;
+                ++failures;
+            }
+            // Failed frames are still forwarded so the stream's sequence has no gap
+            detect_queues[job.stream % n_detect]->push(std::move(frame));
+            window.finish(i);
+        }
+    };
+
+    // Stage 2: detect, one worker per group of streams
+    auto detect_worker = [&](size_t worker) {
+        std::map<size_t, std::unique_ptr<StreamState>> streams;
+        cv::Mat gray, mask, morph;  // reused across frames unless handed to the writer
+        Frame frame;
+        while (detect_queues[worker]->pop(frame)) {
+            auto& state = streams[frame.stream];
+            if (!state) {
+                state = std::make_unique<StreamState>(options);
+                long index;
+                split_frame_name(frame.name, state->name, index);
+            }
+            state->pending.emplace(frame.seq, std::move(frame));
+
+            for (auto it = state->pending.find(state->next_seq); it != state->pending.end();
+                 it = state->pending.find(state->next_seq)) {
+                Frame ready = std::move(it->second);
+                state->pending.erase(it);
+                ++state->next_seq;
+                if (ready.image.empty()) continue;
+
+                ready.boxes = state->detector.detect(ready.image, gray, mask, morph);
+
+                // Sampled debug stages take the buffer with them; the next frame allocates a new one
+                if (ready.seq % debug_every == 0) {
+                    if (options.debug_stages & DEBUG_GRAY)  ready.gray = std::move(gray);
+                    if (options.debug_stages & DEBUG_MASK)  ready.mask = std::move(mask);
+                    if (options.debug_stages & DEBUG_MORPH) ready.morph = std::move(morph);
+                }
+                if (state->tracker) state->tracker->update(ready.boxes, static_cast<int64_t>(ready.seq));
+                write_queue.push(std::move(ready));
+            }
+        }
+
+        if (!options.track) return;
+        std::lock_guard<std::mutex> lock(log_mutex);
+        for (auto& entry : streams) finished_streams[entry.first] = std::move(entry.second);
+    };
+
+    // Stage 3: annotate, then hand encoding and file I/O to the background writer
+    auto write_worker = [&]() {
+        Frame frame;
+        while (write_queue.pop(frame)) {
+            annotate_frame(frame.image, frame.boxes);
+
+            // Save output image
+            image_writer.write(options.output_img_dir + frame.name + ".jpg", std::move(frame.image));
+
+            // Save detection results
+            if (!results.append(frame.id, frame.timestamp_us, frame.name, frame.boxes)) ++failures;
+
+            // Save sampled debug stages
+            if (!frame.gray.empty())
+                image_writer.write(options.debug_gray_dir + frame.name + ".jpg", std::move(frame.gray));
+            if (!frame.mask.empty())
+                image_writer.write(options.debug_mask_dir + frame.name + ".jpg", std::move(frame.mask));
+            if (!frame.morph.empty())
+                image_writer.write(options.debug_morph_dir + frame.name + ".jpg", std::move(frame.morph));
+
+            std::lock_guard<std::mutex> lock(log_mutex);
+            std::cout << "[DEBUG] " << frame.name << " - Found " << frame.boxes.size() << " vehicles\n";
+        }
+    };
+
+    std::vector<std::thread> decoders, detectors, writers;
+    for (size_t i = 0; i < n_threads; ++i) writers.emplace_back(write_worker);
+    for (size_t i = 0; i < n_detect; ++i) detectors.emplace_back(detect_worker, i);
+    for (size_t i = 0; i < n_threads; ++i) decoders.emplace_back(decode_worker);
+
+    // Shut the stages down front to back so every queue is drained
+    for (auto& t : decoders) t.join();
+    for (auto& q : detect_queues) q->close();
+    for (auto& t : detectors) t.join();
+    write_queue.close();
+    for (auto& t : writers) t.join();
+    image_writer.finish();
+    if (!results.flush()) ++failures;
+
+    if (options.track) {
+        uint64_t vehicles = 0;
+        for (const auto& entry : finished_streams) {
+            const StreamState& state = *entry.second;
+            print_tracking_summary("stream " + (state.name.empty() ? std::to_string(entry.first) : state.name),
+                                   *state.tracker);
+            vehicles += state.tracker->vehicles();
+        }
+        if (finished_streams.size() > 1)
+            std::cout << "[TRACK] total: " << vehicles << " vehicles in " << finished_streams.size() << " streams\n";
+    }
+
+    return failures.load() + image_writer.failures();
+}
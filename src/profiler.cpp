@@ -0,0 +1,368 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace {
+
+constexpr int kSubBuckets = LatencyHistogram::kSubBuckets;
+constexpr size_t kMaxTraceEvents = 1 << 20;
+
+int bucket_index(uint64_t ns) {
+    if (ns < kSubBuckets) return static_cast<int>(ns);
+#if defined(__GNUC__)
+    int msb = 63 - __builtin_clzll(ns);
+#else
+    int msb = 63;
+    while (!(ns >> msb)) --msb;
+#endif
+    int sub = static_cast<int>((ns >> (msb - 3)) & (kSubBuckets - 1));
+    return (msb - 2) * kSubBuckets + sub;
+}
+
+double bucket_mid_ns(int index) {
+    if (index < kSubBuckets) return index;
+    int msb = index / kSubBuckets + 2;
+    double width = std::ldexp(1.0, msb - 3);
+    return (kSubBuckets + index % kSubBuckets) * width + width / 2;
+}
+
+struct TraceEvent {
+    Stage stage;
+    int tid;
+    int64_t start_ns;
+    int64_t dur_ns;
+};
+
+struct StageStats {
+    LatencyHistogram latency;
+    int64_t total_ns = 0;
+    uint64_t bytes = 0;
+};
+
+// Written only by its own thread, read by collect_profile() once that thread is done
+struct ThreadProfile {
+    int tid = 0;
+    std::array<StageStats, kNumStages> stages;
+    std::vector<TraceEvent> events;
+    uint64_t dropped = 0;
+};
+
+void merge_profile(ThreadProfile& dst, const ThreadProfile& src) {
+    for (int s = 0; s < kNumStages; ++s) {
+        StageStats& a = dst.stages[s];
+        const StageStats& b = src.stages[s];
+        a.latency.merge(b.latency);
+        a.total_ns += b.total_ns;
+        a.bytes += b.bytes;
+    }
+    dst.events.insert(dst.events.end(), src.events.begin(), src.events.end());
+    dst.dropped += src.dropped;
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;  // live threads
+    ThreadProfile retired;  // samples of threads that have exited
+    std::atomic<bool> trace{false};
+    int64_t origin_ns = 0;
+    int next_tid = 0;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadProfile* t_profile = nullptr;
+
+// Merges the thread's samples into the registry and frees its entry when the
+// thread exits, so short-lived worker threads do not accumulate profiles
+struct ThreadProfileOwner {
+    ThreadProfile* profile = nullptr;
+
+    ~ThreadProfileOwner() {
+        if (!profile) return;
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        merge_profile(reg.retired, *profile);
+        auto it = std::find_if(reg.threads.begin(), reg.threads.end(),
+                               [this](const std::unique_ptr<ThreadProfile>& p) { return p.get() == profile; });
+        if (it != reg.threads.end()) reg.threads.erase(it);
+        t_profile = nullptr;
+    }
+};
+
+thread_local ThreadProfileOwner t_profile_owner;
+
+ThreadProfile& thread_profile() {
+    if (!t_profile) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::make_unique<ThreadProfile>());
+        t_profile = reg.threads.back().get();
+        t_profile->tid = ++reg.next_tid;
+        t_profile_owner.profile = t_profile;
+    }
+    return *t_profile;
+}
+
+// Counts cv::Mat buffers, which OpenCV allocates without operator new
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator* inner) : inner_(inner) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        cv::UMatData* u = inner_->allocate(dims, sizes, type, data, step, flags, usage);
+        if (u && !data) profiler_detail::allocated_bytes += u->size;
+        return u;
+    }
+    bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        return inner_->allocate(u, flags, usage);
+    }
+    void deallocate(cv::UMatData* u) const override { inner_->deallocate(u); }
+
+private:
+    cv::MatAllocator* inner_;
+};
+
+// Never freed: Mats may still be created after main() returns
+CountingMatAllocator* g_mat_allocator = nullptr;
+cv::MatAllocator* g_previous_allocator = nullptr;
+
+void write_json_report(std::ostream& os, const ProfileReport& report, const std::string& indent) {
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << "{\n" << indent << "  \"wall_s\": " << report.wall_s << ",\n" << indent << "  \"stages\": [";
+    bool first = true;
+    for (int s = 0; s < kNumStages; ++s) {
+        const StageProfile& p = report.stages[s];
+        if (p.count == 0) continue;
+        os << (first ? "\n" : ",\n") << indent << "    {\"name\": \"" << stage_name(static_cast<Stage>(s)) << "\""
+           << ", \"count\": " << p.count
+           << ", \"total_ms\": " << p.total_ms
+           << ", \"per_s\": " << (p.total_ms > 0 ? p.count * 1000.0 / p.total_ms : 0.0)
+           << ", \"p50_us\": " << p.p50_us
+           << ", \"p95_us\": " << p.p95_us
+           << ", \"p99_us\": " << p.p99_us
+           << ", \"max_us\": " << p.max_us
+           << ", \"bytes\": " << p.bytes << "}";
+        first = false;
+    }
+    os << "\n" << indent << "  ]\n" << indent << "}";
+    os.flags(flags);
+    os.precision(precision);
+}
+
+} // namespace
+
+namespace profiler_detail {
+
+std::atomic<bool> enabled{false};
+thread_local uint64_t allocated_bytes = 0;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t thread_allocated_bytes() {
+    return allocated_bytes;
+}
+
+void record(Stage stage, int64_t start_ns, int64_t end_ns, uint64_t bytes) {
+    ThreadProfile& profile = thread_profile();
+    int64_t dur = std::max<int64_t>(0, end_ns - start_ns);
+    StageStats& stats = profile.stages[static_cast<int>(stage)];
+    stats.latency.add(dur);
+    stats.total_ns += dur;
+    stats.bytes += bytes;
+
+    if (registry().trace.load(std::memory_order_relaxed)) {
+        if (profile.events.size() < kMaxTraceEvents)
+            profile.events.push_back({stage, profile.tid, start_ns, dur});
+        else
+            ++profile.dropped;
+    }
+}
+
+} // namespace profiler_detail
+
+void LatencyHistogram::add(int64_t ns) {
+    ns = std::max<int64_t>(0, ns);
+    ++buckets_[bucket_index(static_cast<uint64_t>(ns))];
+    ++count_;
+    max_ns_ = std::max(max_ns_, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int b = 0; b < kNumBuckets; ++b) buckets_[b] += other.buckets_[b];
+    count_ += other.count_;
+    max_ns_ = std::max(max_ns_, other.max_ns_);
+}
+
+double LatencyHistogram::percentile_ns(double p) const {
+    if (count_ == 0) return 0.0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * count_)));
+    uint64_t seen = 0;
+    for (int b = 0; b < kNumBuckets; ++b) {
+        seen += buckets_[b];
+        if (seen >= rank) return std::min(bucket_mid_ns(b), static_cast<double>(max_ns_));
+    }
+    return static_cast<double>(max_ns_);
+}
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::Decode:     return "decode";
+    case Stage::Resize:     return "resize";
+    case Stage::Gray:       return "gray";
+    case Stage::Background: return "bg_subtract";
+    case Stage::Threshold:  return "threshold";
+    case Stage::Morphology: return "morphology";
+    case Stage::FrontEnd:   return "fused_front_end";
+    case Stage::Blobs:      return "blobs";
+    case Stage::Filter:     return "filter";
+    case Stage::Refine:     return "refine";
+    case Stage::Track:      return "track";
+    case Stage::Annotate:   return "annotate";
+    case Stage::Encode:     return "encode";
+    case Stage::Write:      return "write";
+    case Stage::Results:    return "results";
+    default:                return "unknown";
+    }
+}
+
+void enable_profiling(bool trace) {
+    Registry& reg = registry();
+    reg.trace = trace;
+    if (!g_mat_allocator) {
+        g_previous_allocator = cv::Mat::getDefaultAllocator();
+        g_mat_allocator = new CountingMatAllocator(g_previous_allocator);
+    }
+    cv::Mat::setDefaultAllocator(g_mat_allocator);
+    reset_profile();
+    profiler_detail::enabled = true;
+}
+
+void disable_profiling() {
+    profiler_detail::enabled = false;
+    // Mats allocated through the wrapper are freed by the allocator it wraps
+    if (g_mat_allocator) cv::Mat::setDefaultAllocator(g_previous_allocator);
+}
+
+void reset_profile() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto& thread : reg.threads) {
+        thread->stages = {};
+        thread->events.clear();
+        thread->dropped = 0;
+    }
+    reg.retired.stages = {};
+    reg.retired.events.clear();
+    reg.retired.dropped = 0;
+    reg.origin_ns = profiler_detail::now_ns();
+}
+
+ProfileReport collect_profile() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    ProfileReport report;
+    report.wall_s = (profiler_detail::now_ns() - reg.origin_ns) / 1e9;
+
+    std::vector<const ThreadProfile*> profiles = {&reg.retired};
+    for (const auto& thread : reg.threads) profiles.push_back(thread.get());
+
+    for (int s = 0; s < kNumStages; ++s) {
+        StageProfile& out = report.stages[s];
+        LatencyHistogram latency;
+        int64_t total_ns = 0;
+        for (const ThreadProfile* thread : profiles) {
+            const StageStats& stats = thread->stages[s];
+            latency.merge(stats.latency);
+            out.bytes += stats.bytes;
+            total_ns += stats.total_ns;
+        }
+        out.count = latency.count();
+        out.total_ms = total_ns / 1e6;
+        out.max_us = latency.max_ns() / 1e3;
+        out.p50_us = latency.percentile_ns(0.50) / 1e3;
+        out.p95_us = latency.percentile_ns(0.95) / 1e3;
+        out.p99_us = latency.percentile_ns(0.99) / 1e3;
+    }
+    for (const ThreadProfile* thread : profiles) report.dropped_events += thread->dropped;
+    return report;
+}
+
+void print_profile(const ProfileReport& report) {
+    std::cout << "[PROFILE] " << std::left << std::setw(16) << "stage" << std::right
+              << std::setw(10) << "calls" << std::setw(12) << "total ms" << std::setw(10) << "per s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p95 us" << std::setw(10) << "p99 us"
+              << std::setw(12) << "KB/call" << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    for (int s = 0; s < kNumStages; ++s) {
+        const StageProfile& p = report.stages[s];
+        if (p.count == 0) continue;
+        std::cout << "[PROFILE] " << std::left << std::setw(16) << stage_name(static_cast<Stage>(s)) << std::right
+                  << std::setw(10) << p.count << std::setw(12) << p.total_ms
+                  << std::setw(10) << (p.total_ms > 0 ? p.count * 1000.0 / p.total_ms : 0.0)
+                  << std::setw(10) << p.p50_us << std::setw(10) << p.p95_us << std::setw(10) << p.p99_us
+                  << std::setw(12) << p.bytes / 1024.0 / p.count << "\n";
+    }
+    std::cout << "[PROFILE] wall " << report.wall_s << " s\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    if (report.dropped_events > 0)
+        std::cout << "[PROFILE] " << report.dropped_events << " trace events over the per-thread limit were dropped\n";
+}
+
+void write_profile_json(std::ostream& os, const ProfileReport& report, const std::string& indent) {
+    write_json_report(os, report, indent);
+}
+
+bool write_profile_json(const std::string& path, const ProfileReport& report) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to write to file: " << path << std::endl;
+        return false;
+    }
+    write_json_report(ofs, report, "");
+    ofs << "\n";
+    return static_cast<bool>(ofs);
+}
+
+bool write_chrome_trace(const std::string& path) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to write to file: " << path << std::endl;
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    std::vector<const ThreadProfile*> profiles = {&reg.retired};
+    for (const auto& thread : reg.threads) profiles.push_back(thread.get());
+    bool first = true;
+    for (const ThreadProfile* thread : profiles) {
+        for (const TraceEvent& e : thread->events) {
+            ofs << (first ? "\n" : ",\n")
+                << "{\"name\": \"" << stage_name(e.stage) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.tid
+                << ", \"ts\": " << (e.start_ns - reg.origin_ns) / 1e3 << ", \"dur\": " << e.dur_ns / 1e3 << "}";
+            first = false;
+        }
+    }
+    ofs << "\n]}\n";
+    return static_cast<bool>(ofs);
+}
@@ -0,0 +1,195 @@
+#include "stream.hpp"
+#include "detector.hpp"
+#include "latest_frame_slot.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "fs_compat.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct TimedFrame {
+    long index = -1;
+    Clock::time_point captured;
+    int64_t timestamp_us = 0;  // wall clock capture time, for the results file
+    cv::Mat image;
+};
+
+double elapsed_ms(Clock::time_point since, Clock::time_point until) {
+    return std::chrono::duration<double, std::milli>(until - since).count();
+}
+
+// A purely numeric source is a camera index, anything else goes to the
+// backend as a file name, device path or URL.
+bool open_source(cv::VideoCapture& cap, const std::string& source) {
+    bool is_index = !source.empty() && source.size() < 6 &&
+                    std::all_of(source.begin(), source.end(),
+                                [](unsigned char c) { return std::isdigit(c) != 0; });
+    return is_index ? cap.open(std::stoi(source)) : cap.open(source);
+}
+
+volatile std::sig_atomic_t g_interrupted = 0;
+
+extern "C" void on_interrupt(int sig) {
+    g_interrupted = 1;
+    // A second signal ends the process as usual
+    std::signal(sig, SIG_DFL);
+}
+
+// Turns SIGINT/SIGTERM into a request to stop capturing for as long as it
+// lives, so an endless camera or RTSP source still ends with the summary
+struct InterruptToStop {
+    InterruptToStop() {
+        g_interrupted = 0;
+        prev_int = std::signal(SIGINT, on_interrupt);
+        prev_term = std::signal(SIGTERM, on_interrupt);
+    }
+    ~InterruptToStop() {
+        std::signal(SIGINT, prev_int);
+        std::signal(SIGTERM, prev_term);
+    }
+    InterruptToStop(const InterruptToStop&) = delete;
+    InterruptToStop& operator=(const InterruptToStop&) = delete;
+
+    void (*prev_int)(int);
+    void (*prev_term)(int);
+};
+
+} // namespace
+
+int run_stream(const StreamOptions& options) {
+    cv::VideoCapture cap;
+    if (!open_source(cap, options.source) || !cap.isOpened()) {
+        std::cerr << "Failed to open stream: " << options.source << std::endl;
+        return 1;
+    }
+
+    ResultsSink results(options.results_format, results_path_for(options.results_format, options.results_path));
+    if (!results.is_open()) return 1;
+
+    // Debug images are encoded off the detection thread
+    std::unique_ptr<AsyncImageWriter> debug_writer;
+    if (options.debug_stages != DEBUG_NONE) {
+        if (options.debug_stages & DEBUG_GRAY)  fs::create_directories(options.debug_gray_dir);
+        if (options.debug_stages & DEBUG_MASK)  fs::create_directories(options.debug_mask_dir);
+        if (options.debug_stages & DEBUG_MORPH) fs::create_directories(options.debug_morph_dir);
+        debug_writer = std::make_unique<AsyncImageWriter>(options.writer);
+    }
+    const long debug_every = std::max(1, options.debug_every);
+
+    // Replaying a file at its recorded frame rate makes it stand in for a live camera
+    Clock::duration frame_period = Clock::duration::zero();
+    double source_fps = cap.get(cv::CAP_PROP_FPS);
+    if (options.pace_files && source_fps > 0 && fs::is_regular_file(options.source)) {
+        frame_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / source_fps));
+    }
+
+    LatestFrameSlot<TimedFrame> slot;
+    std::atomic<long> captured{0};
+    std::atomic<long> overwritten{0};
+    std::atomic<bool> stop{false};
+    InterruptToStop interrupt;
+
+    const Clock::time_point start = Clock::now();
+
+    std::thread capture_thread([&]() {
+        Clock::time_point next = Clock::now();
+        for (long i = 0; !stop && !g_interrupted && (options.max_frames <= 0 || i < options.max_frames); ++i) {
+            TimedFrame frame;
+            {
+                ScopedTimer timer(Stage::Decode);
+                if (!cap.read(frame.image) || frame.image.empty()) break;
+            }
+            if (frame_period != Clock::duration::zero()) {
+                next += frame_period;
+                std::this_thread::sleep_until(next);
+            }
+            frame.index = i;
+            frame.captured = Clock::now();
+            frame.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            ++captured;
+            if (slot.put(std::move(frame))) ++overwritten;
+        }
+        slot.close();
+    });
+
+    VehicleDetector detector(options.detector);
+    std::unique_ptr<Tracker> tracker;
+    if (options.track) tracker = std::make_unique<Tracker>(options.tracker, options.zones);
+    cv::Mat gray, mask, morph;
+    LatencyHistogram latency;  // fixed size however long the stream runs
+    long processed = 0;
+    long over_budget = 0;
+
+    TimedFrame frame;
+    long sink_failures = 0;
+    // A joinable std::thread must not be destroyed, so an exception from
+    // detection or the writers stops and joins the capture thread first
+    try {
+        while (slot.take(frame)) {
+            // Detection fell behind: skip the frame rather than report stale results
+            if (options.latency_budget_ms > 0 &&
+                elapsed_ms(frame.captured, Clock::now()) > options.latency_budget_ms) {
+                ++over_budget;
+                continue;
+            }
+
+            std::vector<cv::Rect> car_boxes = detector.detect(frame.image, gray, mask, morph);
+            if (tracker) tracker->update(car_boxes, frame.index);
+            const double latency_ms = elapsed_ms(frame.captured, Clock::now());
+            latency.add(static_cast<int64_t>(latency_ms * 1e6));
+            ++processed;
+
+            const std::string name = "frame_" + std::to_string(frame.index);
+            if (!results.append(static_cast<uint64_t>(frame.index), frame.timestamp_us, name, car_boxes))
+                ++sink_failures;
+
+            // The writer takes the buffers; the next frame allocates new ones
+            if (debug_writer && frame.index % debug_every == 0) {
+                if (options.debug_stages & DEBUG_GRAY)
+                    debug_writer->write(options.debug_gray_dir + name + ".jpg", std::move(gray));
+                if (options.debug_stages & DEBUG_MASK)
+                    debug_writer->write(options.debug_mask_dir + name + ".jpg", std::move(mask));
+                if (options.debug_stages & DEBUG_MORPH)
+                    debug_writer->write(options.debug_morph_dir + name + ".jpg", std::move(morph));
+            }
+
+            if (options.verbose) {
+                std::cout << "[DEBUG] frame " << frame.index << " - Found " << car_boxes.size()
+                          << " vehicles (" << latency_ms << " ms)\n";
+            }
+        }
+    } catch (...) {
+        stop = true;
+        capture_thread.join();
+        throw;
+    }
+    capture_thread.join();
+    if (!results.flush()) ++sink_failures;
+    if (debug_writer) debug_writer->finish();
+
+    double seconds = elapsed_ms(start, Clock::now()) / 1000.0;
+    double fps = seconds > 0 ? processed / seconds : 0.0;
+    std::cout << "[STREAM] captured " << captured << ", processed " << processed
+              << ", dropped " << (overwritten + over_budget)
+              << " (" << overwritten << " overwritten, " << over_budget << " over budget)\n";
+    std::cout << "[STREAM] " << fps << " FPS, latency p50 " << latency.percentile_ns(0.50) / 1e6
+              << " ms, p99 " << latency.percentile_ns(0.99) / 1e6 << " ms\n";
+    if (tracker) print_tracking_summary("", *tracker);
+
+    if (sink_failures > 0) return 1;
+    return debug_writer && debug_writer->failures() > 0 ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+#include "sweep.hpp"
+#include "config_file.hpp"
+#include "evaluate.hpp"
+#include "parallel_for.hpp"
+#include "pipeline.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct SweepSpec {
+    std::string mode = "grid";
+    int samples = 100;
+    unsigned seed = 1;
+    std::string metric = "f1";
+    std::vector<std::pair<std::string, std::vector<std::string>>> params;
+};
+
+struct SweepPoint {
+    DetectorParams params;
+    std::vector<std::pair<std::string, std::string>> assignment;  // swept key = value
+    size_t blob_stage = 0;
+    size_t refine_stage = std::numeric_limits<size_t>::max();  // none at pyramid level 0
+    EvaluationResult result;
+    double map = 0.0;
+    double score = 0.0;
+};
+
+// One distinct front end setting. Its masks are consumed frame by frame by
+// the blob and refine stages built on it and never kept.
+struct MaskStage {
+    DetectorParams params;
+    std::vector<size_t> blob_stages;
+};
+
+// Blob features for one distinct mask + extractor setting
+struct BlobStage {
+    DetectorParams params;
+    size_t mask_stage = 0;
+    std::vector<size_t> refine_stages;
+    std::vector<std::vector<BlobFeatures>> blobs;  // per frame
+    std::vector<std::vector<cv::Rect>> boxes;      // per frame and blob, scaled to image coordinates
+    std::vector<double> frame_area;                // working-resolution frame area per frame
+};
+
+// Refined output boxes for one blob stage and refine threshold (pyramid levels > 0)
+struct RefineStage {
+    size_t blob_stage = 0;
+    int threshold = 0;
+    double min_area_frac = std::numeric_limits<double>::max();  // loosest area limit of its points
+    std::vector<std::vector<cv::Rect>> boxes;  // per frame and blob, in image coordinates
+};
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, sep)) parts.push_back(trim(part));
+    return parts;
+}
+
+std::string format_number(double v) {
+    std::ostringstream os;
+    os.precision(10);
+    os << v;
+    return os.str();
+}
+
+// "v1, v2, v3" or "lo:hi:step"
+bool expand_values(const std::string& text, std::vector<std::string>& values) {
+    if (text.find(':') != std::string::npos && text.find(',') == std::string::npos) {
+        std::vector<std::string> parts = split(text, ':');
+        if (parts.size() != 3) return false;
+        char* end = nullptr;
+        double lo = std::strtod(parts[0].c_str(), &end);
+        double hi = std::strtod(parts[1].c_str(), &end);
+        double step = std::strtod(parts[2].c_str(), &end);
+        if (step <= 0 || hi < lo || (hi - lo) / step > 100000) return false;
+        for (int i = 0; lo + i * step <= hi + step * 1e-6; ++i) values.push_back(format_number(lo + i * step));
+        return true;
+    }
+    for (const auto& v : split(text, ',')) {
+        if (!v.empty()) values.push_back(v);
+    }
+    return !values.empty();
+}
+
+bool load_spec(const std::string& path, SweepSpec& spec) {
+    return read_config_file(path, "sweep spec", [&](const std::string& key, const std::string& value) {
+        bool ok = !key.empty();
+        if (key == "mode") {
+            spec.mode = value;
+            ok = value == "grid" || value == "random";
+        } else if (key == "samples") {
+            spec.samples = std::atoi(value.c_str());
+            ok = spec.samples > 0;
+        } else if (key == "seed") {
+            spec.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (key == "metric") {
+            spec.metric = value;
+            ok = value == "f1" || value == "map";
+        } else if (ok) {
+            std::vector<std::string> values;
+            ok = expand_values(value, values);
+            DetectorParams scratch;
+            for (const auto& v : values) ok = ok && set_detector_param(scratch, key, v);
+            if (ok) spec.params.emplace_back(key, std::move(values));
+        }
+        return ok;
+    });
+}
+
+std::vector<SweepPoint> make_points(const SweepSpec& spec, const DetectorParams& base) {
+    std::vector<SweepPoint> points;
+    const size_t n_params = spec.params.size();
+    std::vector<size_t> pick(n_params, 0);
+
+    auto add_point = [&]() {
+        SweepPoint point;
+        point.params = base;
+        for (size_t k = 0; k < n_params; ++k) {
+            const auto& key = spec.params[k].first;
+            const auto& value = spec.params[k].second[pick[k]];
+            set_detector_param(point.params, key, value);
+            point.assignment.emplace_back(key, value);
+        }
+        // Swept limits can cross (min_area_frac above max_area_frac); such points detect nothing
+        if (!detector_params_consistent(point.params)) return;
+        // Cache keys and box scaling must see the values the detector runs with
+        point.params = sanitized_detector_params(point.params);
+        points.push_back(std::move(point));
+    };
+
+    if (spec.mode == "random") {
+        std::mt19937 rng(spec.seed);
+        for (int s = 0; s < spec.samples; ++s) {
+            for (size_t k = 0; k < n_params; ++k)
+                pick[k] = std::uniform_int_distribution<size_t>(0, spec.params[k].second.size() - 1)(rng);
+            add_point();
+        }
+        return points;
+    }
+
+    // Grid: odometer over every combination
+    while (true) {
+        add_point();
+        size_t k = 0;
+        for (; k < n_params; ++k) {
+            if (++pick[k] < spec.params[k].second.size()) break;
+            pick[k] = 0;
+        }
+        if (k == n_params) break;
+    }
+    return points;
+}
+
+// Parameters that change the morph mask, as the mask stage sees them after
+// sanitized_detector_params(): kernel sizes that round to the same odd kernel
+// at this level share one mask
+std::string mask_key(const DetectorParams& p) {
+    std::ostringstream os;
+    os.precision(10);
+    os << static_cast<int>(p.front_end) << '|' << p.pyramid_level << '|' << p.fused.kernel_size;
+    if (p.front_end == FrontEnd::Fused)
+        os << '|' << p.fused.fg_threshold << '|' << p.fused.adapt_step;
+    else
+        os << '|' << p.mog2_history << '|' << p.mog2_var_threshold << '|' << p.shadow_threshold;
+    return os.str();
+}
+
+// Parameters that change the blob features
+std::string blob_key(const DetectorParams& p) {
+    std::ostringstream os;
+    os << mask_key(p) << '|' << static_cast<int>(p.blob_extractor);
+    return os.str();
+}
+
+double elapsed_s(Clock::time_point since) {
+    return std::chrono::duration<double>(Clock::now() - since).count();
+}
+
+} // namespace
+
+int run_sweep(const SweepOptions& options) {
+    SweepSpec spec;
+    if (!load_spec(options.spec_path, spec)) return 1;
+
+    GroundTruthIndex ground_truth;
+    if (!load_ground_truth(options.ground_truth_path, ground_truth)) {
+        std::cerr << "No ground truth loaded from " << options.ground_truth_path << std::endl;
+        return 1;
+    }
+
+    size_t n_streams = 0;
+    std::vector<FrameJob> jobs = collect_frame_jobs(options.image_dir, n_streams);
+    if (jobs.empty()) {
+        std::cerr << "No images found in " << options.image_dir << std::endl;
+        return 1;
+    }
+    const size_t n_frames = jobs.size();
+
+    std::vector<SweepPoint> points = make_points(spec, options.base);
+    if (points.empty()) {
+        std::cerr << "No sweep point in " << options.spec_path << " has consistent min/max limits" << std::endl;
+        return 1;
+    }
+
+    // Deduplicate the expensive stages across sweep points
+    std::vector<MaskStage> masks;
+    std::vector<BlobStage> blobs;
+    std::vector<RefineStage> refines;
+    std::map<std::string, size_t> mask_ids, blob_ids;
+    std::map<std::pair<size_t, int>, size_t> refine_ids;
+    for (auto& point : points) {
+        auto m = mask_ids.emplace(mask_key(point.params), masks.size());
+        if (m.second) {
+            masks.emplace_back();
+            masks.back().params = point.params;
+        }
+        auto b = blob_ids.emplace(blob_key(point.params), blobs.size());
+        if (b.second) {
+            blobs.emplace_back();
+            BlobStage& stage = blobs.back();
+            stage.params = point.params;
+            stage.mask_stage = m.first->second;
+            masks[stage.mask_stage].blob_stages.push_back(b.first->second);
+            stage.blobs.resize(n_frames);
+            stage.boxes.resize(n_frames);
+            stage.frame_area.resize(n_frames, 0.0);
+        }
+        point.blob_stage = b.first->second;
+        if (point.params.pyramid_level <= 0) continue;
+
+        // Refinement depends on the threshold only, so threshold sweeps share the blobs
+        auto r = refine_ids.emplace(std::make_pair(point.blob_stage, point.params.refine_threshold), refines.size());
+        if (r.second) {
+            refines.emplace_back();
+            refines.back().blob_stage = point.blob_stage;
+            refines.back().threshold = point.params.refine_threshold;
+            refines.back().boxes.resize(n_frames);
+            blobs[point.blob_stage].refine_stages.push_back(r.first->second);
+        }
+        point.refine_stage = r.first->second;
+        RefineStage& refine = refines[point.refine_stage];
+        refine.min_area_frac = std::min(refine.min_area_frac, point.params.min_area_frac);
+    }
+    std::cout << "[SWEEP] " << points.size() << " points, " << masks.size() << " mask stages, "
+              << blobs.size() << " blob stages, " << refines.size() << " refine stages, "
+              << n_frames << " frames\n";
+
+    const size_t n_workers = static_cast<size_t>(std::max(1, options.threads));
+
+    // Frames of each stream in order; jobs are interleaved by sequence number
+    std::vector<std::vector<size_t>> streams(n_streams);
+    for (size_t i = 0; i < n_frames; ++i) streams[jobs[i].stream].push_back(i);
+
+    // Stages 1 and 2: the background model is temporal, so one task runs a
+    // whole stream in order for one mask setting. Each frame is decoded,
+    // masked, reduced to blob features and refined at full resolution before
+    // the next one, so only the features outlive it and memory does not grow
+    // with frames x mask stages x frame size.
+    auto start = Clock::now();
+    std::vector<BlobBuffers> blob_buffers(n_workers);
+    std::vector<RefineBuffers> refine_buffers(n_workers);
+    parallel_for(masks.size() * n_streams, options.threads, [&](size_t task, size_t worker) {
+        const MaskStage& mask = masks[task / n_streams];
+        VehicleDetector detector(mask.params);
+        cv::Mat image, gray, fg, morph, bg;
+        for (size_t i : streams[task % n_streams]) {
+            image = cv::imread(jobs[i].path);
+            if (image.empty()) continue;
+            detector.compute_mask(image, gray, fg, morph);
+            const int level = detector.level();
+            if (level > 0) detector.background(bg);
+
+            for (size_t b : mask.blob_stages) {
+                BlobStage& stage = blobs[b];
+                extract_blob_features(morph, stage.params.blob_extractor, stage.blobs[i], blob_buffers[worker]);
+                stage.frame_area[i] = static_cast<double>(morph.total());
+                for (const auto& blob : stage.blobs[i])
+                    stage.boxes[i].push_back(
+                        refine_box(image, cv::Mat(), blob.box, level, 0, refine_buffers[worker]));
+
+                // Full-resolution refinement, only for blobs that some point of
+                // the stage could accept (same rounded limit as accept_blob)
+                for (size_t r : stage.refine_stages) {
+                    RefineStage& refine = refines[r];
+                    DetectorParams loosest = stage.params;
+                    loosest.min_area_frac = refine.min_area_frac;
+                    double min_area, max_area;
+                    area_limits(loosest, stage.frame_area[i], min_area, max_area);
+
+                    for (size_t k = 0; k < stage.blobs[i].size(); ++k) {
+                        const cv::Rect& box = stage.blobs[i][k].box;
+                        if (box.area() >= min_area)
+                            refine.boxes[i].push_back(refine_box(image, bg, box, level, refine.threshold,
+                                                                 refine_buffers[worker]));
+                        else
+                            refine.boxes[i].push_back(stage.boxes[i][k]);
+                    }
+                }
+            }
+        }
+    });
+    double stage_seconds = elapsed_s(start);
+
+    // Stage 3: filter the cached features and score every point. Ground truth
+    // images are resolved to frame indices once; every image counts, frames
+    // or not, as in evaluate_dataset(). AP is only computed for metric = map.
+    start = Clock::now();
+    std::map<std::string, std::vector<size_t>> frames_by_name;
+    for (size_t i = 0; i < n_frames; ++i) frames_by_name[jobs[i].name].push_back(i);
+    std::vector<const std::vector<BoundingBox>*> gt_images;
+    std::vector<std::vector<size_t>> gt_frames;
+    for (const auto& kv : ground_truth) {
+        gt_images.push_back(&kv.second);
+        auto it = frames_by_name.find(kv.first);
+        gt_frames.push_back(it != frames_by_name.end() ? it->second : std::vector<size_t>());
+    }
+
+    const bool with_ap = spec.metric == "map";
+    std::vector<std::vector<std::vector<Prediction>>> point_preds(
+        n_workers, std::vector<std::vector<Prediction>>(gt_images.size()));
+    std::vector<MatchScratch> match_scratch(n_workers);
+    parallel_for(points.size(), options.threads, [&](size_t p, size_t worker) {
+        SweepPoint& point = points[p];
+        const BlobStage& stage = blobs[point.blob_stage];
+        const auto& boxes = point.refine_stage < refines.size() ? refines[point.refine_stage].boxes : stage.boxes;
+
+        std::vector<std::vector<Prediction>>& preds = point_preds[worker];
+        for (size_t g = 0; g < gt_images.size(); ++g) {
+            preds[g].clear();
+            for (size_t i : gt_frames[g]) {
+                for (size_t k = 0; k < stage.blobs[i].size(); ++k) {
+                    if (accept_blob(stage.blobs[i][k], point.params, stage.frame_area[i]))
+                        preds[g].push_back({boxes[i][k], 1.0f});
+                }
+            }
+        }
+
+        DatasetEvaluation eval = evaluate_images(gt_images, preds, with_ap, match_scratch[worker]);
+        point.result = eval.total;
+        point.map = eval.map;
+        point.score = with_ap ? eval.map : eval.total.f1;
+    });
+    double point_seconds = elapsed_s(start);
+
+    std::cout << "[SWEEP] masks, blobs and refine " << stage_seconds << " s, points "
+              << point_seconds << " s (" << 1e6 * point_seconds * options.threads / std::max<size_t>(1, points.size())
+              << " us per point and thread)\n";
+
+    std::stable_sort(points.begin(), points.end(),
+                     [](const SweepPoint& a, const SweepPoint& b) { return a.score > b.score; });
+
+    const size_t n_top = std::min<size_t>(points.size(), static_cast<size_t>(std::max(1, options.top)));
+    for (size_t p = 0; p < n_top; ++p) {
+        const SweepPoint& point = points[p];
+        std::cout << "[SWEEP] #" << p + 1 << " " << spec.metric << " " << point.score
+                  << " (P " << point.result.precision << ", R " << point.result.recall
+                  << ", F1 " << point.result.f1;
+        if (with_ap) std::cout << ", AP[.5:.95] " << point.map;
+        std::cout << ")";
+        for (const auto& kv : point.assignment) std::cout << " " << kv.first << "=" << kv.second;
+        std::cout << "\n";
+    }
+
+    if (!options.output_path.empty() && !points.empty()) {
+        if (!save_detector_params(options.output_path, points.front().params)) return 1;
+        std::cout << "[SWEEP] best parameters written to " << options.output_path << "\n";
+    }
+    return 0;
+}
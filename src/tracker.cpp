@@ -0,0 +1,391 @@
+#include "tracker.hpp"
+#include "config_file.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+float cross(float ax, float ay, float bx, float by) {
+    return ax * by - ay * bx;
+}
+
+bool point_in_polygon(const std::vector<cv::Point2f>& poly, float x, float y) {
+    bool inside = false;
+    for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++) {
+        if ((poly[i].y > y) != (poly[j].y > y) &&
+            x < (poly[j].x - poly[i].x) * (y - poly[i].y) / (poly[j].y - poly[i].y) + poly[i].x)
+            inside = !inside;
+    }
+    return inside;
+}
+
+uint32_t hash_cell(int ix, int iy, uint32_t mask) {
+    return (static_cast<uint32_t>(ix) * 73856093u ^ static_cast<uint32_t>(iy) * 19349663u) & mask;
+}
+
+int cell_of(float v, float cell) {
+    return static_cast<int>(std::floor(v / cell));
+}
+
+// Counting sort of n items (ids id_at(i), centers xs[id], ys[id]) into hash buckets
+template <typename Grid, typename IdAt>
+void fill_grid(Grid& grid, size_t n, IdAt id_at, const float* xs, const float* ys, float cell) {
+    const uint32_t mask = static_cast<uint32_t>(grid.fill.size() - 1);
+    std::fill(grid.start.begin(), grid.start.end(), 0);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t id = id_at(i);
+        uint32_t b = hash_cell(cell_of(xs[id], cell), cell_of(ys[id], cell), mask);
+        grid.bucket[id] = b;
+        ++grid.start[b + 1];
+    }
+    for (size_t b = 1; b < grid.start.size(); ++b) grid.start[b] += grid.start[b - 1];
+    std::copy(grid.start.begin(), grid.start.end() - 1, grid.fill.begin());
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t id = id_at(i);
+        grid.items[grid.fill[grid.bucket[id]]++] = id;
+    }
+}
+
+// Starts a new de-duplication round over the stamps
+uint32_t next_query(std::vector<uint32_t>& stamp, uint32_t& query) {
+    if (++query == 0) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        query = 1;
+    }
+    return query;
+}
+
+// Calls fn(id) once for every item in the cells within reach of (x, y) on both axes
+template <typename Grid, typename Fn>
+void visit_grid(const Grid& grid, float cell, float x, float y, float reach,
+                std::vector<uint32_t>& stamp, uint32_t& query, Fn fn) {
+    const int x0 = cell_of(x - reach, cell), x1 = cell_of(x + reach, cell);
+    const int y0 = cell_of(y - reach, cell), y1 = cell_of(y + reach, cell);
+
+    // Wider than the table: every bucket would be visited anyway
+    const size_t n_buckets = grid.fill.size();
+    if (static_cast<double>(x1 - x0 + 1) * (y1 - y0 + 1) >= static_cast<double>(n_buckets)) {
+        for (uint32_t k = 0; k < grid.start[n_buckets]; ++k) fn(grid.items[k]);
+        return;
+    }
+
+    // Cells can share a bucket; the stamp visits each item once
+    const uint32_t q = next_query(stamp, query);
+    const uint32_t mask = static_cast<uint32_t>(n_buckets - 1);
+    for (int iy = y0; iy <= y1; ++iy) {
+        for (int ix = x0; ix <= x1; ++ix) {
+            uint32_t b = hash_cell(ix, iy, mask);
+            for (uint32_t k = grid.start[b]; k < grid.start[b + 1]; ++k) {
+                uint32_t id = grid.items[k];
+                if (stamp[id] == q) continue;
+                stamp[id] = q;
+                fn(id);
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool load_counting_zones(const std::string& path, std::vector<CountingZone>& zones) {
+    return read_config_file(path, "counting zones", [&](const std::string& name, const std::string& value) {
+        CountingZone zone;
+        zone.name = name;
+        std::stringstream ss(value);
+        std::string kind;
+        ss >> kind;
+        std::vector<float> coords;
+        float v;
+        while (ss >> v) coords.push_back(v);
+        for (size_t i = 0; i + 1 < coords.size(); i += 2) zone.points.emplace_back(coords[i], coords[i + 1]);
+        bool ok = !zone.name.empty() && ss.eof() && coords.size() % 2 == 0 && zones.size() < kMaxCountingZones;
+        if (kind == "line") {
+            zone.kind = CountingZone::Kind::Line;
+            ok = ok && zone.points.size() == 2;
+        } else if (kind == "polygon") {
+            zone.kind = CountingZone::Kind::Polygon;
+            ok = ok && zone.points.size() >= 3;
+        } else {
+            ok = false;
+        }
+        if (ok) zones.push_back(std::move(zone));
+        return ok;
+    });
+}
+
+Tracker::Tracker(const TrackerParams& params, std::vector<CountingZone> zones)
+    : params_(params), zones_(std::move(zones)) {
+    if (zones_.size() > kMaxCountingZones) zones_.resize(kMaxCountingZones);
+    for (const auto& zone : zones_) counts_.push_back({zone.name, zone.kind, 0, 0});
+
+    const size_t n = std::max<size_t>(1, params_.capacity);
+    for (auto* v : {&cx_, &cy_, &w_, &h_, &vx_, &vy_, &px_, &py_}) v->assign(n, 0.0f);
+    for (auto* v : {&inside_, &counted_fwd_, &counted_bwd_, &pending_fwd_, &pending_bwd_}) v->assign(n, 0);
+    for (auto* v : {&hits_, &stamp_}) v->assign(n, 0);
+    last_frame_.assign(n, 0);
+    track_matched_.assign(n, 0);
+    active_.reserve(n);
+    survivors_.reserve(n);
+    free_.reserve(n);
+    for (size_t t = n; t-- > 0;) free_.push_back(static_cast<uint32_t>(t));
+
+    size_t n_buckets = 1;
+    while (n_buckets < 2 * n) n_buckets <<= 1;
+    for (Grid* grid : {&track_grid_, &detection_grid_}) {
+        grid->start.assign(n_buckets + 1, 0);
+        grid->fill.assign(n_buckets, 0);
+    }
+    track_grid_.items.assign(n, 0);
+    track_grid_.bucket.assign(n, 0);
+    sizes_.reserve(2 * n);
+    candidates_.reserve(4 * n);
+}
+
+void Tracker::update(const std::vector<cv::Rect>& boxes, int64_t frame) {
+    ScopedTimer timer(Stage::Track);
+
+    // Step 1: Predict every live track to this frame
+    predict(frame);
+
+    // Step 2: Size the grid cells from the typical box, not the largest one, so
+    // an oversized blob does not put every track into the same cell
+    float cell = static_cast<float>(params_.cell_size);
+    if (cell <= 0) {
+        sizes_.clear();
+        for (uint32_t t : active_) sizes_.push_back(std::max(w_[t], h_[t]));
+        for (const auto& box : boxes) sizes_.push_back(static_cast<float>(std::max(box.width, box.height)));
+        if (!sizes_.empty()) {
+            auto mid = sizes_.begin() + sizes_.size() / 2;
+            std::nth_element(sizes_.begin(), mid, sizes_.end());
+            cell = *mid;
+        }
+    }
+    cell_ = std::max(1.0f, cell);
+
+    // Step 3: Score the track/detection pairs within reach of each other
+    collect_candidates(boxes);
+
+    // Step 4: Greedy assignment, best pair first
+    detection_matched_.assign(boxes.size(), 0);
+    for (uint32_t t : active_) track_matched_[t] = 0;
+    std::sort(candidates_.begin(), candidates_.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.track != b.track ? a.track < b.track : a.detection < b.detection;
+    });
+    for (const auto& c : candidates_) {
+        if (track_matched_[c.track] || detection_matched_[c.detection]) continue;
+        track_matched_[c.track] = 1;
+        detection_matched_[c.detection] = 1;
+        update_track(c.track, boxes[c.detection], frame);
+    }
+
+    // Step 5: Retire tracks that have not been matched for too long
+    survivors_.clear();
+    for (uint32_t t : active_) {
+        if (track_matched_[t] || frame - last_frame_[t] <= params_.max_missed)
+            survivors_.push_back(t);
+        else
+            free_.push_back(t);
+    }
+    active_.swap(survivors_);
+
+    // Step 6: Start tracks for the unmatched detections
+    for (size_t d = 0; d < boxes.size(); ++d) {
+        if (!detection_matched_[d]) spawn_track(boxes[d], frame);
+    }
+}
+
+void Tracker::predict(int64_t frame) {
+    for (uint32_t t : active_) {
+        float dt = static_cast<float>(frame - last_frame_[t]);
+        px_[t] = cx_[t] + vx_[t] * dt;
+        py_[t] = cy_[t] + vy_[t] * dt;
+    }
+}
+
+// A pair can only match when its centers are within max(reach_t, reach_d) on
+// both axes: reach_t = max(w, h, center gate) of the track, reach_d = max(w, h)
+// of the detection (overlapping boxes are closer than the larger size). Each
+// side searches the other's grid within its own reach, so a pair is scored by
+// the detection when it lies within reach_d and by the track otherwise.
+void Tracker::collect_candidates(const std::vector<cv::Rect>& boxes) {
+    candidates_.clear();
+    const size_t n = boxes.size();
+    det_x_.resize(n);
+    det_y_.resize(n);
+    det_reach_.resize(n);
+    for (size_t d = 0; d < n; ++d) {
+        det_x_[d] = boxes[d].x + boxes[d].width * 0.5f;
+        det_y_[d] = boxes[d].y + boxes[d].height * 0.5f;
+        det_reach_[d] = static_cast<float>(std::max(boxes[d].width, boxes[d].height));
+    }
+    auto chebyshev = [&](uint32_t t, uint32_t d) {
+        return std::max(std::abs(det_x_[d] - px_[t]), std::abs(det_y_[d] - py_[t]));
+    };
+
+    // Detections look for the tracks within their own size
+    fill_grid(track_grid_, active_.size(), [&](size_t i) { return active_[i]; }, px_.data(), py_.data(), cell_);
+    for (uint32_t d = 0; d < n; ++d) {
+        visit_grid(track_grid_, cell_, det_x_[d], det_y_[d], det_reach_[d], stamp_, query_, [&](uint32_t t) {
+            if (chebyshev(t, d) <= det_reach_[d]) consider(t, d, boxes[d]);
+        });
+    }
+
+    // Tracks look for the detections beyond that but within their own size or gate
+    detection_grid_.items.resize(n);
+    detection_grid_.bucket.resize(n);
+    detection_stamp_.resize(n, 0);
+    fill_grid(detection_grid_, n, [](size_t i) { return static_cast<uint32_t>(i); },
+              det_x_.data(), det_y_.data(), cell_);
+    for (uint32_t t : active_) {
+        const float gate = static_cast<float>(params_.center_gate) * std::hypot(w_[t], h_[t]);
+        const float reach = std::max({w_[t], h_[t], gate});
+        visit_grid(detection_grid_, cell_, px_[t], py_[t], reach, detection_stamp_, detection_query_,
+                   [&](uint32_t d) {
+                       float dist = chebyshev(t, d);
+                       if (dist > det_reach_[d] && dist <= reach) consider(t, d, boxes[d]);
+                   });
+    }
+}
+
+void Tracker::consider(uint32_t t, uint32_t d, const cv::Rect& box) {
+    // IoU with the predicted box
+    float x0 = std::max(px_[t] - w_[t] * 0.5f, static_cast<float>(box.x));
+    float y0 = std::max(py_[t] - h_[t] * 0.5f, static_cast<float>(box.y));
+    float x1 = std::min(px_[t] + w_[t] * 0.5f, static_cast<float>(box.x + box.width));
+    float y1 = std::min(py_[t] + h_[t] * 0.5f, static_cast<float>(box.y + box.height));
+    float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+    float uni = w_[t] * h_[t] + static_cast<float>(box.area()) - inter;
+    float iou = uni > 0 ? inter / uni : 0.0f;
+
+    // Center distance, for small or fast objects that no longer overlap
+    float gate = static_cast<float>(params_.center_gate) * std::hypot(w_[t], h_[t]);
+    float dist = std::hypot(det_x_[d] - px_[t], det_y_[d] - py_[t]);
+    if (iou < params_.min_iou && dist > gate) return;
+
+    float closeness = gate > 0 ? std::max(0.0f, 1.0f - dist / gate) : 0.0f;
+    candidates_.push_back({iou + 0.1f * closeness, t, d});
+}
+
+void Tracker::update_track(uint32_t t, const cv::Rect& box, int64_t frame) {
+    const float mcx = box.x + box.width * 0.5f;
+    const float mcy = box.y + box.height * 0.5f;
+    const float dt = static_cast<float>(std::max<int64_t>(1, frame - last_frame_[t]));
+
+    // Constant velocity, smoothed over the measurements
+    float nvx = (mcx - cx_[t]) / dt;
+    float nvy = (mcy - cy_[t]) / dt;
+    float a = hits_[t] == 1 ? 1.0f : static_cast<float>(params_.velocity_smoothing);
+    vx_[t] = a * nvx + (1.0f - a) * vx_[t];
+    vy_[t] = a * nvy + (1.0f - a) * vy_[t];
+
+    ++hits_[t];
+    cross_zones(t, cx_[t], cy_[t], mcx, mcy);
+    if (hits_[t] == static_cast<uint32_t>(std::max(1, params_.min_hits))) confirm(t);
+
+    cx_[t] = mcx;
+    cy_[t] = mcy;
+    w_[t] = static_cast<float>(box.width);
+    h_[t] = static_cast<float>(box.height);
+    last_frame_[t] = frame;
+}
+
+void Tracker::spawn_track(const cv::Rect& box, int64_t frame) {
+    if (free_.empty()) {
+        ++untracked_;
+        return;
+    }
+    uint32_t t = free_.back();
+    free_.pop_back();
+    active_.push_back(t);
+
+    cx_[t] = box.x + box.width * 0.5f;
+    cy_[t] = box.y + box.height * 0.5f;
+    w_[t] = static_cast<float>(box.width);
+    h_[t] = static_cast<float>(box.height);
+    vx_[t] = vy_[t] = 0.0f;
+    last_frame_[t] = frame;
+    hits_[t] = 1;
+    counted_fwd_[t] = counted_bwd_[t] = pending_fwd_[t] = pending_bwd_[t] = 0;
+    stamp_[t] = 0;
+
+    inside_[t] = 0;
+    for (size_t z = 0; z < zones_.size(); ++z) {
+        if (zones_[z].kind == CountingZone::Kind::Polygon && point_in_polygon(zones_[z].points, cx_[t], cy_[t]))
+            inside_[t] |= uint64_t(1) << z;
+    }
+    if (params_.min_hits <= 1) confirm(t);
+}
+
+// Tests the center's move from (x0, y0) to (x1, y1) against every zone
+void Tracker::cross_zones(uint32_t t, float x0, float y0, float x1, float y1) {
+    for (size_t z = 0; z < zones_.size(); ++z) {
+        const auto& pts = zones_[z].points;
+        if (zones_[z].kind == CountingZone::Kind::Polygon) {
+            const uint64_t bit = uint64_t(1) << z;
+            bool was_inside = (inside_[t] & bit) != 0;
+            bool is_inside = point_in_polygon(pts, x1, y1);
+            if (was_inside == is_inside) continue;
+            inside_[t] ^= bit;
+            count(t, z, is_inside);
+            continue;
+        }
+
+        // Segments intersect when each one's endpoints lie on different sides of the other
+        const cv::Point2f& a = pts[0];
+        const cv::Point2f& b = pts[1];
+        float side0 = cross(b.x - a.x, b.y - a.y, x0 - a.x, y0 - a.y);
+        float side1 = cross(b.x - a.x, b.y - a.y, x1 - a.x, y1 - a.y);
+        if ((side0 > 0) == (side1 > 0)) continue;
+        float end_a = cross(x1 - x0, y1 - y0, a.x - x0, a.y - y0);
+        float end_b = cross(x1 - x0, y1 - y0, b.x - x0, b.y - y0);
+        if ((end_a > 0) == (end_b > 0)) continue;
+        count(t, z, side1 > 0);
+    }
+}
+
+void Tracker::count(uint32_t t, size_t zone, bool forward) {
+    const uint64_t bit = uint64_t(1) << zone;
+    uint64_t seen = forward ? counted_fwd_[t] | pending_fwd_[t] : counted_bwd_[t] | pending_bwd_[t];
+    // A line counts a track once; jitter back across it is ignored
+    if (zones_[zone].kind == CountingZone::Kind::Line)
+        seen = counted_fwd_[t] | pending_fwd_[t] | counted_bwd_[t] | pending_bwd_[t];
+    if (seen & bit) return;
+
+    // Unconfirmed tracks may still be noise; their crossings wait for confirm()
+    if (hits_[t] < static_cast<uint32_t>(std::max(1, params_.min_hits))) {
+        (forward ? pending_fwd_ : pending_bwd_)[t] |= bit;
+        return;
+    }
+    (forward ? counted_fwd_ : counted_bwd_)[t] |= bit;
+    if (forward) ++counts_[zone].forward;
+    else ++counts_[zone].backward;
+}
+
+void Tracker::confirm(uint32_t t) {
+    ++confirmed_;
+    for (size_t z = 0; z < zones_.size(); ++z) {
+        const uint64_t bit = uint64_t(1) << z;
+        if (pending_fwd_[t] & bit) ++counts_[z].forward;
+        if (pending_bwd_[t] & bit) ++counts_[z].backward;
+    }
+    counted_fwd_[t] |= pending_fwd_[t];
+    counted_bwd_[t] |= pending_bwd_[t];
+    pending_fwd_[t] = pending_bwd_[t] = 0;
+}
+
+void print_tracking_summary(const std::string& label, const Tracker& tracker) {
+    const std::string prefix = label.empty() ? "[TRACK] " : "[TRACK] " + label + ": ";
+    std::cout << prefix << tracker.vehicles() << " vehicles tracked";
+    if (tracker.untracked() > 0) std::cout << " (" << tracker.untracked() << " detections over capacity)";
+    std::cout << "\n";
+    for (const auto& zone : tracker.counts()) {
+        bool line = zone.kind == CountingZone::Kind::Line;
+        std::cout << prefix << zone.name << " " << zone.forward << (line ? " forward, " : " in, ")
+                  << zone.backward << (line ? " backward" : " out") << ", total "
+                  << zone.forward + zone.backward << "\n";
+    }
+}
@@ -0,0 +1,336 @@
+#include "writer.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "fs_compat.hpp"
+
+bool parse_debug_stages(const std::string& list, unsigned& stages) {
+    unsigned result = DEBUG_NONE;
+    std::stringstream ss(list);
+    std::string stage;
+    while (std::getline(ss, stage, ',')) {
+        if (stage == "gray") result |= DEBUG_GRAY;
+        else if (stage == "mask") result |= DEBUG_MASK;
+        else if (stage == "morph") result |= DEBUG_MORPH;
+        else if (stage == "all") result |= DEBUG_ALL;
+        else if (stage == "none" || stage.empty()) continue;
+        else return false;
+    }
+    stages = result;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncImageWriter
+
+AsyncImageWriter::AsyncImageWriter(const WriterOptions& options)
+    : queue_(options.queue_capacity) {
+    int n = options.threads > 0 ? options.threads : 1;
+    for (int i = 0; i < n; ++i) workers_.emplace_back(&AsyncImageWriter::worker, this);
+}
+
+AsyncImageWriter::~AsyncImageWriter() {
+    finish();
+}
+
+void AsyncImageWriter::write(std::string path, cv::Mat image) {
+    if (image.empty()) return;
+    queue_.push(Job{std::move(path), std::move(image)});
+}
+
+void AsyncImageWriter::finish() {
+    queue_.close();
+    for (auto& t : workers_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+// Encoding and the file write are separate steps so they can be timed apart
+void AsyncImageWriter::worker() {
+    Job job;
+    std::vector<uchar> encoded;
+    while (queue_.pop(job)) {
+        bool ok;
+        {
+            ScopedTimer timer(Stage::Encode);
+            size_t dot = job.path.rfind('.');
+            ok = dot != std::string::npos && cv::imencode(job.path.substr(dot), job.image, encoded);
+        }
+        job.image.release();
+        if (ok) {
+            ScopedTimer timer(Stage::Write);
+            std::ofstream ofs(job.path, std::ios::binary | std::ios::trunc);
+            ok = ofs.write(reinterpret_cast<const char*>(encoded.data()), encoded.size()) && ofs.flush();
+        }
+        if (!ok) {
+            std::cerr << "Failed to write image: " << job.path << std::endl;
+            ++failures_;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ResultsSink
+
+namespace {
+
+void append_json_string(std::string& out, const std::string& s) {
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+template <typename T>
+void append_raw(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+} // namespace
+
+bool parse_results_format(const std::string& name, ResultsFormat& format) {
+    if (name == "none") format = ResultsFormat::None;
+    else if (name == "txt") format = ResultsFormat::PerFrameText;
+    else if (name == "jsonl") format = ResultsFormat::JsonLines;
+    else if (name == "bin") format = ResultsFormat::Binary;
+    else return false;
+    return true;
+}
+
+std::string results_path_for(ResultsFormat format, const std::string& path, const std::string& txt_dir) {
+    if (!path.empty()) return path;
+    switch (format) {
+    case ResultsFormat::JsonLines: return "output/results.jsonl";
+    case ResultsFormat::Binary:    return "output/results.bin";
+    default:                       return txt_dir;
+    }
+}
+
+ResultsSink::ResultsSink(ResultsFormat format, const std::string& path, size_t flush_bytes)
+    : format_(format), path_(path), flush_bytes_(flush_bytes) {
+    switch (format_) {
+    case ResultsFormat::None:
+        open_ = true;
+        break;
+    case ResultsFormat::PerFrameText:
+        fs::create_directories(path_);
+        open_ = true;
+        break;
+    case ResultsFormat::JsonLines:
+    case ResultsFormat::Binary: {
+        fs::path parent = fs::path(path_).parent_path();
+        if (!parent.empty()) fs::create_directories(parent);
+        file_.open(path_, std::ios::binary | std::ios::trunc);
+        open_ = static_cast<bool>(file_);
+        if (!open_) {
+            std::cerr << "Failed to open results file: " << path_ << std::endl;
+            break;
+        }
+        if (format_ == ResultsFormat::Binary) {
+            buffer_.append("VCRS", 4);
+            append_raw<uint32_t>(buffer_, 1);
+        }
+        buffer_.reserve(flush_bytes_ + 4096);
+        break;
+    }
+    }
+}
+
+ResultsSink::~ResultsSink() {
+    flush();
+}
+
+bool ResultsSink::append(uint64_t frame_id, int64_t timestamp_us, const std::string& name,
+                         const std::vector<cv::Rect>& boxes) {
+    if (!open_) return false;
+
+    if (format_ == ResultsFormat::None) return true;
+
+    ScopedTimer timer(Stage::Results);
+
+    if (format_ == ResultsFormat::PerFrameText) {
+        // Independent files, no shared state to lock
+        std::string txt_path = (fs::path(path_) / (name + ".txt")).string();
+        std::ofstream ofs(txt_path);
+        if (!ofs) {
+            std::cerr << "Failed to write to file: " << txt_path << std::endl;
+            return false;
+        }
+        for (const auto& box : boxes) {
+            ofs << "car " << box.x << " " << box.y << " " << box.width << " " << box.height << "\n";
+        }
+        return static_cast<bool>(ofs);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (format_ == ResultsFormat::JsonLines) {
+        buffer_ += "{\"frame\":";
+        buffer_ += std::to_string(frame_id);
+        buffer_ += ",\"ts_us\":";
+        buffer_ += std::to_string(timestamp_us);
+        buffer_ += ",\"name\":";
+        append_json_string(buffer_, name);
+        buffer_ += ",\"boxes\":[";
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            const cv::Rect& b = boxes[i];
+            if (i > 0) buffer_ += ',';
+            buffer_ += '[' + std::to_string(b.x) + ',' + std::to_string(b.y) + ',' +
+                       std::to_string(b.width) + ',' + std::to_string(b.height) + ']';
+        }
+        buffer_ += "]}\n";
+    } else {
+        size_t name_len = std::min<size_t>(name.size(), UINT16_MAX);
+        append_raw<uint64_t>(buffer_, frame_id);
+        append_raw<int64_t>(buffer_, timestamp_us);
+        append_raw<uint16_t>(buffer_, static_cast<uint16_t>(name_len));
+        buffer_.append(name.data(), name_len);
+        append_raw<uint32_t>(buffer_, static_cast<uint32_t>(boxes.size()));
+        for (const auto& b : boxes) {
+            append_raw<int32_t>(buffer_, b.x);
+            append_raw<int32_t>(buffer_, b.y);
+            append_raw<int32_t>(buffer_, b.width);
+            append_raw<int32_t>(buffer_, b.height);
+        }
+    }
+
+    if (buffer_.size() >= flush_bytes_) flush_locked();
+    return static_cast<bool>(file_);
+}
+
+bool ResultsSink::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush_locked();
+    return !file_.is_open() || static_cast<bool>(file_);
+}
+
+void ResultsSink::flush_locked() {
+    if (!file_.is_open() || buffer_.empty()) return;
+    file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    file_.flush();
+    if (!file_) std::cerr << "Failed to write results file: " << path_ << std::endl;
+    buffer_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// Reading results back
+
+namespace {
+
+template <typename T>
+bool read_raw(const std::string& data, size_t& pos, T& value) {
+    if (pos + sizeof(T) > data.size()) return false;
+    std::memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+bool read_binary_results(const std::string& data, std::vector<FrameResult>& frames) {
+    size_t pos = 4;
+    uint32_t version = 0;
+    if (!read_raw(data, pos, version) || version != 1) return false;
+
+    while (pos < data.size()) {
+        FrameResult frame;
+        uint16_t name_len = 0;
+        uint32_t n_boxes = 0;
+        if (!read_raw(data, pos, frame.frame_id) || !read_raw(data, pos, frame.timestamp_us) ||
+            !read_raw(data, pos, name_len) || pos + name_len > data.size())
+            return false;
+        frame.name.assign(data, pos, name_len);
+        pos += name_len;
+        if (!read_raw(data, pos, n_boxes) || n_boxes > (data.size() - pos) / 16) return false;
+        frame.boxes.resize(n_boxes);
+        for (auto& b : frame.boxes) {
+            int32_t v[4];
+            for (auto& x : v) read_raw(data, pos, x);
+            b = cv::Rect(v[0], v[1], v[2], v[3]);
+        }
+        frames.push_back(std::move(frame));
+    }
+    return true;
+}
+
+// Parses exactly the objects ResultsSink writes, not arbitrary JSON
+bool parse_json_line(const std::string& line, FrameResult& frame) {
+    auto number_after = [&](const char* key, long long& value) {
+        size_t pos = line.find(key);
+        if (pos == std::string::npos) return false;
+        value = std::strtoll(line.c_str() + pos + std::strlen(key), nullptr, 10);
+        return true;
+    };
+    long long frame_id = 0, ts = 0;
+    if (!number_after("\"frame\":", frame_id) || !number_after("\"ts_us\":", ts)) return false;
+    frame.frame_id = static_cast<uint64_t>(frame_id);
+    frame.timestamp_us = ts;
+
+    size_t pos = line.find("\"name\":\"");
+    if (pos == std::string::npos) return false;
+    frame.name.clear();
+    for (pos += 8; pos < line.size() && line[pos] != '"'; ++pos) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) {
+            if (line[pos + 1] == 'u' && pos + 5 < line.size()) {
+                frame.name += static_cast<char>(std::strtol(line.substr(pos + 2, 4).c_str(), nullptr, 16));
+                pos += 5;
+            } else {
+                frame.name += line[++pos];
+            }
+        } else {
+            frame.name += line[pos];
+        }
+    }
+
+    pos = line.find("\"boxes\":[", pos);
+    if (pos == std::string::npos) return false;
+    const char* p = line.c_str() + pos + 9;
+    frame.boxes.clear();
+    while (*p == '[' || *p == ',') {
+        if (*p == ',') ++p;
+        if (*p != '[') break;
+        int v[4];
+        char* end = const_cast<char*>(p + 1);
+        for (int i = 0; i < 4; ++i) {
+            v[i] = static_cast<int>(std::strtol(end, &end, 10));
+            if (*end == ',') ++end;
+        }
+        if (*end != ']') return false;
+        frame.boxes.emplace_back(v[0], v[1], v[2], v[3]);
+        p = end + 1;
+    }
+    return *p == ']';
+}
+
+} // namespace
+
+bool read_results(const std::string& path, std::vector<FrameResult>& frames) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return false;
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    if (data.compare(0, 4, "VCRS") == 0) return read_binary_results(data, frames);
+
+    std::stringstream ss(data);
+    std::string line;
+    while (std::getline(ss, line)) {
+        if (line.empty()) continue;
+        FrameResult frame;
+        if (!parse_json_line(line, frame)) return false;
+        frames.push_back(std::move(frame));
+    }
+    return true;
+}
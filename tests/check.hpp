@@ -0,0 +1,32 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cmath>
+#include <iostream>
+
+// Minimal assertions for the test executables: a failed check is reported
+// and counted, and main() returns nonzero so ctest sees the failure.
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            ++check_failures();                                                       \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_NEAR(a, b, eps)                                                              \
+    do {                                                                                   \
+        double check_a_ = (a), check_b_ = (b);                                             \
+        if (std::abs(check_a_ - check_b_) > (eps)) {                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #a ", " #b ") failed: " \
+                      << check_a_ << " vs " << check_b_ << "\n";                           \
+            ++check_failures();                                                            \
+        }                                                                                  \
+    } while (0)
+
+#endif // CHECK_HPP
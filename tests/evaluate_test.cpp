@@ -0,0 +1,136 @@
+// Matching and AP checks for evaluate_dataset()
+#include "evaluate.hpp"
+#include "check.hpp"
+
+namespace {
+
+BoundingBox gt_box(int x, int y, int w, int h) {
+    BoundingBox b;
+    b.label = "car";
+    b.x = x;
+    b.y = y;
+    b.width = w;
+    b.height = h;
+    return b;
+}
+
+// One image holds a true positive, the other only a false positive. Without
+// scores the two detections tie, so AP must not depend on which image name
+// sorts first.
+void test_ap_ignores_image_names() {
+    for (int swap = 0; swap < 2; ++swap) {
+        const std::string hit = swap ? "b" : "a";
+        const std::string miss = swap ? "a" : "b";
+
+        GroundTruthIndex ground_truth;
+        ground_truth[hit] = {gt_box(10, 10, 50, 40)};
+        ground_truth[miss] = {};
+        PredictionIndex predictions;
+        predictions[hit] = {{cv::Rect(10, 10, 50, 40), 1.0f}};
+        predictions[miss] = {{cv::Rect(200, 200, 30, 30), 1.0f}};
+
+        DatasetEvaluation eval = evaluate_dataset(ground_truth, predictions, 1);
+        CHECK(eval.total.tp == 1);
+        CHECK(eval.total.fp == 1);
+        CHECK_NEAR(eval.ap[0], 0.5, 1e-9);  // precision 1/2 at recall 1
+    }
+}
+
+// Distinct scores still rank: the true positive first gives AP 1
+void test_ap_ranks_by_score() {
+    GroundTruthIndex ground_truth;
+    ground_truth["a"] = {gt_box(10, 10, 50, 40)};
+    ground_truth["b"] = {};
+    PredictionIndex predictions;
+    predictions["a"] = {{cv::Rect(10, 10, 50, 40), 0.9f}};
+    predictions["b"] = {{cv::Rect(200, 200, 30, 30), 0.4f}};
+
+    DatasetEvaluation eval = evaluate_dataset(ground_truth, predictions, 1);
+    CHECK_NEAR(eval.ap[0], 1.0, 1e-9);
+
+    predictions["a"][0].score = 0.4f;
+    predictions["b"][0].score = 0.9f;
+    eval = evaluate_dataset(ground_truth, predictions, 1);
+    CHECK_NEAR(eval.ap[0], 0.5, 1e-9);
+}
+
+// Predictions for a stem missing from the ground truth are counted, not scored
+void test_skipped_predictions() {
+    GroundTruthIndex ground_truth;
+    ground_truth["a"] = {gt_box(10, 10, 50, 40)};
+    PredictionIndex predictions;
+    predictions["a"] = {{cv::Rect(10, 10, 50, 40), 1.0f}};
+    predictions["typo"] = {{cv::Rect(0, 0, 20, 20), 1.0f}, {cv::Rect(40, 40, 20, 20), 1.0f}};
+
+    DatasetEvaluation eval = evaluate_dataset(ground_truth, predictions, 1);
+    CHECK(eval.total.fp == 0);
+    CHECK(eval.skipped_images == 1);
+    CHECK(eval.skipped_predictions == 2);
+}
+
+// IoU 0.5 match that fails the stricter thresholds
+void test_iou_thresholds() {
+    GroundTruthIndex ground_truth;
+    ground_truth["a"] = {gt_box(0, 0, 100, 100)};
+    PredictionIndex predictions;
+    predictions["a"] = {{cv::Rect(0, 0, 100, 60), 1.0f}};  // IoU 0.6
+
+    DatasetEvaluation eval = evaluate_dataset(ground_truth, predictions, 2);
+    CHECK(eval.total.tp == 1);
+    CHECK_NEAR(eval.ap[0], 1.0, 1e-9);
+    CHECK_NEAR(eval.ap[2], 1.0, 1e-9);  // 0.60
+    CHECK_NEAR(eval.ap[3], 0.0, 1e-9);  // 0.65
+}
+
+// The sweep's index-based scoring agrees with evaluate_dataset(), and skips AP
+// unless asked
+void test_evaluate_images_matches_dataset() {
+    GroundTruthIndex ground_truth;
+    ground_truth["a"] = {gt_box(10, 10, 50, 40), gt_box(100, 100, 40, 40)};
+    ground_truth["b"] = {gt_box(0, 0, 20, 20)};
+    PredictionIndex predictions;
+    predictions["a"] = {{cv::Rect(12, 10, 50, 40), 1.0f}, {cv::Rect(300, 300, 10, 10), 1.0f}};
+    predictions["b"] = {{cv::Rect(0, 0, 20, 18), 1.0f}};
+    DatasetEvaluation expected = evaluate_dataset(ground_truth, predictions, 1);
+
+    std::vector<const std::vector<BoundingBox>*> gt = {&ground_truth["b"], &ground_truth["a"]};
+    std::vector<std::vector<Prediction>> preds = {predictions["b"], predictions["a"]};
+    MatchScratch scratch;
+    DatasetEvaluation with_ap = evaluate_images(gt, preds, true, scratch);
+    CHECK(with_ap.total.tp == expected.total.tp);
+    CHECK(with_ap.total.fp == expected.total.fp);
+    CHECK(with_ap.total.fn == expected.total.fn);
+    CHECK_NEAR(with_ap.map, expected.map, 1e-9);
+
+    DatasetEvaluation f1_only = evaluate_images(gt, preds, false, scratch);
+    CHECK_NEAR(f1_only.total.f1, expected.total.f1, 1e-9);
+    CHECK(f1_only.map == 0.0);
+}
+
+// Matched predictions are drawn green, unmatched ones red and missed ground
+// truth blue; the matched ground truth box is hidden under its prediction
+void test_overlay_colors() {
+    std::vector<BoundingBox> gt = {gt_box(10, 10, 30, 30), gt_box(10, 60, 20, 20)};
+    std::vector<Prediction> preds = {{cv::Rect(10, 10, 30, 30), 1.0f}, {cv::Rect(60, 10, 20, 20), 1.0f}};
+    cv::Mat image = cv::Mat::zeros(100, 100, CV_8UC3);
+    MatchScratch scratch;
+    draw_match_overlay(image, gt, preds, scratch);
+
+    // Midpoints of the top edges, (row, column)
+    CHECK(image.at<cv::Vec3b>(10, 25) == cv::Vec3b(0, 255, 0));
+    CHECK(image.at<cv::Vec3b>(10, 70) == cv::Vec3b(0, 0, 255));
+    CHECK(image.at<cv::Vec3b>(60, 20) == cv::Vec3b(255, 0, 0));
+    CHECK(image.at<cv::Vec3b>(50, 50) == cv::Vec3b(0, 0, 0));
+}
+
+} // namespace
+
+int main() {
+    test_ap_ignores_image_names();
+    test_ap_ranks_by_score();
+    test_skipped_predictions();
+    test_iou_thresholds();
+    test_evaluate_images_matches_dataset();
+    test_overlay_colors();
+    return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// FusedFrontEnd against a naive per-pixel reference
+#include <algorithm>
+#include <cstdlib>
+#include "frontend.hpp"
+#include "check.hpp"
+
+namespace {
+
+// Straightforward per-pixel versions of what FusedFrontEnd computes: gray with
+// cvtColor's fixed-point weights, the approximate-median background and a
+// closing with the window clipped at the frame border.
+struct ReferenceFrontEnd {
+    FusedFrontEndParams params;
+    cv::Mat background;
+
+    void process(const cv::Mat& image, cv::Mat& gray, cv::Mat& mask, cv::Mat& morph) {
+        const int rows = image.rows, cols = image.cols;
+        const int radius = params.kernel_size / 2;
+        const bool first = background.size() != image.size();
+        gray.create(rows, cols, CV_8UC1);
+        mask.create(rows, cols, CV_8UC1);
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < cols; ++x) {
+                const cv::Vec3b& bgr = image.at<cv::Vec3b>(y, x);
+                gray.at<uchar>(y, x) = static_cast<uchar>((bgr[0] * 1868 + bgr[1] * 9617 + bgr[2] * 4899 + 8192) >> 14);
+            }
+        }
+        if (first) {
+            background = gray.clone();
+            mask.setTo(cv::Scalar(0));
+        } else {
+            for (int y = 0; y < rows; ++y) {
+                for (int x = 0; x < cols; ++x) {
+                    int g = gray.at<uchar>(y, x);
+                    uchar& b = background.at<uchar>(y, x);
+                    mask.at<uchar>(y, x) = std::abs(g - b) > params.fg_threshold ? 255 : 0;
+                    b = static_cast<uchar>(b + std::max(-params.adapt_step, std::min(params.adapt_step, g - b)));
+                }
+            }
+        }
+        cv::Mat dilated;
+        window_extreme(mask, dilated, radius, true);
+        window_extreme(dilated, morph, radius, false);
+    }
+
+    static void window_extreme(const cv::Mat& src, cv::Mat& dst, int radius, bool is_max) {
+        dst.create(src.rows, src.cols, CV_8UC1);
+        for (int y = 0; y < src.rows; ++y) {
+            for (int x = 0; x < src.cols; ++x) {
+                int v = is_max ? 0 : 255;
+                for (int yy = std::max(0, y - radius); yy <= std::min(src.rows - 1, y + radius); ++yy)
+                    for (int xx = std::max(0, x - radius); xx <= std::min(src.cols - 1, x + radius); ++xx)
+                        v = is_max ? std::max<int>(v, src.at<uchar>(yy, xx)) : std::min<int>(v, src.at<uchar>(yy, xx));
+                dst.at<uchar>(y, x) = static_cast<uchar>(v);
+            }
+        }
+    }
+};
+
+// Runs the fused and reference front ends side by side over seeded random
+// frames. Widths straddle the vector lane counts so the SIMD tails and the
+// scalar borders are covered; strip heights and kernel sizes vary so the ring
+// buffers wrap at every offset.
+void test_matches_reference() {
+    cv::RNG rng(4242);
+    const int kernel_sizes[] = {1, 3, 5, 7, 9};
+    for (int trial = 0; trial < 200; ++trial) {
+        FusedFrontEndParams params;
+        params.kernel_size = kernel_sizes[rng.uniform(0, 5)];
+        params.strip_rows = rng.uniform(0, 3) == 0 ? 0 : rng.uniform(1, 17);
+        params.fg_threshold = rng.uniform(0, 60);
+        params.adapt_step = rng.uniform(1, 6);
+        const int rows = rng.uniform(1, 80);
+        const int cols = rng.uniform(0, 4) == 0 ? rng.uniform(64, 400) : rng.uniform(1, 100);
+
+        FusedFrontEnd fused(params);
+        ReferenceFrontEnd reference;
+        reference.params = params;
+
+        // A fixed pattern with sparse noise, so masks have structure and the
+        // background drifts by more than one step in places
+        cv::Mat pattern(rows, cols, CV_8UC3), image(rows, cols, CV_8UC3);
+        rng.fill(pattern, cv::RNG::UNIFORM, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+        cv::Mat gray, mask, morph, ref_gray, ref_mask, ref_morph;
+        for (int frame = 0; frame < 4; ++frame) {
+            pattern.copyTo(image);
+            for (int n = rows * cols / 4; n > 0; --n) {
+                image.at<cv::Vec3b>(rng.uniform(0, rows), rng.uniform(0, cols)) =
+                    cv::Vec3b(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+            }
+            fused.process(image, gray, mask, morph);
+            reference.process(image, ref_gray, ref_mask, ref_morph);
+
+            const char* stage = nullptr;
+            if (cv::norm(gray, ref_gray, cv::NORM_INF) > 0) stage = "gray";
+            else if (cv::norm(fused.background(), reference.background, cv::NORM_INF) > 0) stage = "background";
+            else if (cv::norm(mask, ref_mask, cv::NORM_INF) > 0) stage = "mask";
+            else if (cv::norm(morph, ref_morph, cv::NORM_INF) > 0) stage = "closing";
+            if (stage) {
+                std::cerr << cols << "x" << rows << " kernel " << params.kernel_size << " strip "
+                          << params.strip_rows << " frame " << frame << ": " << stage << " differs\n";
+            }
+            CHECK(stage == nullptr);
+            if (stage) break;
+        }
+    }
+}
+
+// No difference exceeds 255, so nothing is foreground; the vector compare
+// must not wrap threshold + 1 to 0 and mark everything instead
+void test_threshold_255() {
+    FusedFrontEndParams params;
+    params.fg_threshold = 255;
+    params.adapt_step = 255;
+    params.kernel_size = 1;
+    FusedFrontEnd fused(params);
+    cv::Mat gray, mask, morph;
+    fused.process(cv::Mat(8, 100, CV_8UC3, cv::Scalar(0, 0, 0)), gray, mask, morph);
+    fused.process(cv::Mat(8, 100, CV_8UC3, cv::Scalar(255, 255, 255)), gray, mask, morph);
+    CHECK(cv::countNonZero(mask) == 0);
+    CHECK(cv::countNonZero(morph) == 0);
+}
+
+} // namespace
+
+int main() {
+    test_matches_reference();
+    test_threshold_255();
+    return check_failures() == 0 ? 0 : 1;
+}
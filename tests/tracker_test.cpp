@@ -0,0 +1,127 @@
+// Association and zone counting checks for Tracker
+#include "tracker.hpp"
+#include "check.hpp"
+
+namespace {
+
+CountingZone line_zone(float x0, float y0, float x1, float y1) {
+    CountingZone zone;
+    zone.name = "line";
+    zone.kind = CountingZone::Kind::Line;
+    zone.points = {{x0, y0}, {x1, y1}};
+    return zone;
+}
+
+CountingZone box_zone(float x0, float y0, float x1, float y1) {
+    CountingZone zone;
+    zone.name = "box";
+    zone.kind = CountingZone::Kind::Polygon;
+    zone.points = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+    return zone;
+}
+
+// Feeds one 30x20 box moving from x0 by dx per frame
+void drive(Tracker& tracker, int x0, int y, int dx, int frames) {
+    for (int f = 0; f < frames; ++f) tracker.update({cv::Rect(x0 + dx * f, y, 30, 20)}, f);
+}
+
+// Walking down the line x = 500, the right-hand side is the left of the
+// screen: a box moving left crosses forward, one moving right backward
+void test_line_directions() {
+    Tracker left(TrackerParams(), {line_zone(500, 0, 500, 1000)});
+    drive(left, 700, 100, -10, 40);
+    CHECK(left.vehicles() == 1);
+    CHECK(left.counts()[0].forward == 1);
+    CHECK(left.counts()[0].backward == 0);
+
+    Tracker right(TrackerParams(), {line_zone(500, 0, 500, 1000)});
+    drive(right, 300, 100, 10, 40);
+    CHECK(right.vehicles() == 1);
+    CHECK(right.counts()[0].forward == 0);
+    CHECK(right.counts()[0].backward == 1);
+}
+
+// A crossing before min_hits is held back and counted on confirmation;
+// a track that never confirms never counts
+void test_line_pending_until_confirmed() {
+    TrackerParams params;
+    params.min_hits = 3;
+    Tracker early(params, {line_zone(500, 0, 500, 1000)});
+    drive(early, 480, 100, 10, 5);  // crosses on the second detection
+    CHECK(early.counts()[0].backward == 1);
+
+    Tracker noise(params, {line_zone(500, 0, 500, 1000)});
+    drive(noise, 480, 100, 10, 2);
+    CHECK(noise.vehicles() == 0);
+    CHECK(noise.counts()[0].backward == 0);
+}
+
+void test_polygon_entry_and_exit() {
+    Tracker tracker(TrackerParams(), {box_zone(400, 0, 600, 1000)});
+    drive(tracker, 200, 100, 10, 60);  // center 215 -> 805
+    CHECK(tracker.vehicles() == 1);
+    CHECK(tracker.counts()[0].forward == 1);   // in
+    CHECK(tracker.counts()[0].backward == 1);  // out
+
+    // Starting inside is not an entry
+    Tracker inside(TrackerParams(), {box_zone(400, 0, 600, 1000)});
+    drive(inside, 450, 100, 10, 30);
+    CHECK(inside.counts()[0].forward == 0);
+    CHECK(inside.counts()[0].backward == 1);
+}
+
+// Rows of boxes 25 px apart, every row crossing the line in both directions
+void test_dense_scene() {
+    const int rows = 400;
+    Tracker tracker(TrackerParams(), {line_zone(500, 0, 500, 100000)});
+    for (int f = 0; f < 60; ++f) {
+        std::vector<cv::Rect> boxes;
+        for (int r = 0; r < rows; ++r) {
+            int dir = r % 2 ? -1 : 1;
+            boxes.emplace_back(500 - dir * 200 + dir * 8 * f, 25 * r, 30, 20);
+        }
+        tracker.update(boxes, f);
+    }
+    CHECK(tracker.vehicles() == static_cast<uint64_t>(rows));
+    CHECK(tracker.live_tracks() == static_cast<size_t>(rows));
+    CHECK(tracker.counts()[0].forward == static_cast<uint64_t>(rows / 2));
+    CHECK(tracker.counts()[0].backward == static_cast<uint64_t>(rows / 2));
+}
+
+// A frame-sized blob next to small vehicles must not disturb their tracks
+void test_large_blob() {
+    const int rows = 50;
+    Tracker tracker(TrackerParams(), {line_zone(500, 0, 500, 100000)});
+    for (int f = 0; f < 60; ++f) {
+        std::vector<cv::Rect> boxes;
+        for (int r = 0; r < rows; ++r) boxes.emplace_back(300 + 8 * f, 25 * r, 30, 20);
+        boxes.emplace_back(0, 2000, 4000, 3000);
+        tracker.update(boxes, f);
+    }
+    CHECK(tracker.vehicles() == static_cast<uint64_t>(rows + 1));
+    CHECK(tracker.counts()[0].backward == static_cast<uint64_t>(rows));
+}
+
+// A small detection inside the gate of a large track but outside its own
+// reach is only found from the track's side of the search
+void test_large_track_gate() {
+    TrackerParams params;
+    params.min_hits = 1;
+    Tracker tracker(params);
+    tracker.update({cv::Rect(0, 0, 200, 200)}, 0);        // center (100, 100), gate ~141
+    tracker.update({cv::Rect(180, 80, 40, 40)}, 1);       // center (200, 100), reach 40
+    CHECK(tracker.vehicles() == 1);
+    CHECK(tracker.live_tracks() == 1);
+}
+
+} // namespace
+
+int main() {
+    test_line_directions();
+    test_line_pending_until_confirmed();
+    test_polygon_entry_and_exit();
+    test_dense_scene();
+    test_large_blob();
+    test_large_track_gate();
+    return check_failures() == 0 ? 0 : 1;
+}